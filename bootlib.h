@@ -2,34 +2,232 @@
 #ifndef BOOTLIB_H
 #define BOOTLIB_H
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
+// Size class k counts blocks of (2^(k-1), 2^k] bytes, the last class
+// collects everything larger.
+#define BOOT_SIZE_CLASSES 32
+
+typedef struct BootStats {
+  size_t live_bytes;
+  size_t peak_bytes;
+  size_t live_count;
+  size_t alloc_count;
+  size_t free_count;
+  size_t realloc_count;
+  size_t size_classes[BOOT_SIZE_CLASSES];
+} boot_stats_t;
+
 void* boot_malloc(size_t size);
+void* boot_calloc(size_t count, size_t size);
+void* boot_realloc(void* ptr, size_t size);
+void* boot_aligned_alloc(size_t alignment, size_t size);
 void boot_free(void* ptr);
+bool boot_is_freed(void* ptr);
 bool boot_all_freed(void);
+size_t boot_alloc_size(void);
+size_t boot_realloc_count(void);
+boot_stats_t boot_stats(void);
+void boot_stats_dump(void);
 
-#define malloc boot_malloc
-#define free boot_free
-
-typedef struct Node {
+// Live allocations are kept in an open-addressing hash table keyed by the
+// pointer itself (linear probing, backward-shift deletion), so tracking and
+// untracking are O(1) on average and no extra node is malloc'd per block.
+typedef struct BootAllocation {
   void* ptr;
-  struct Node* next;
-} Node;
+  size_t size;
+} boot_allocation_t;
+
+#define BOOT_TABLE_INITIAL_CAPACITY 1024
+
+static boot_allocation_t* boot_table = NULL;
+static size_t boot_table_capacity = 0;
+static size_t boot_table_count = 0;
+static boot_stats_t boot_counters = {0};
+
+// Collector threads allocate and free too, a spinlock keeps the table sane
+static atomic_flag boot_lock = ATOMIC_FLAG_INIT;
+
+static void boot_lock_acquire(void) {
+  while (atomic_flag_test_and_set_explicit(&boot_lock, memory_order_acquire)) {
+  }
+}
+
+static void boot_lock_release(void) {
+  atomic_flag_clear_explicit(&boot_lock, memory_order_release);
+}
+
+static size_t boot_hash(void* ptr, size_t capacity) {
+  // Fibonacci hashing, malloc'd pointers are at least 16 byte aligned. Take
+  // the upper half of the product, the low bits only depend on the low bits
+  // of the key and page-aligned blocks would all collide.
+  uint64_t key = (uintptr_t)ptr >> 4;
+  return (size_t)((key * 11400714819323198485ull) >> 32) & (capacity - 1);
+}
+
+static size_t boot_table_find(void* ptr) {
+  size_t i = boot_hash(ptr, boot_table_capacity);
+  while (boot_table[i].ptr != NULL && boot_table[i].ptr != ptr) {
+    i = (i + 1) & (boot_table_capacity - 1);
+  }
+  return i;
+}
+
+static bool boot_table_grow(void) {
+  size_t old_capacity = boot_table_capacity;
+  boot_allocation_t* old_table = boot_table;
+
+  size_t new_capacity =
+      old_capacity ? old_capacity * 2 : BOOT_TABLE_INITIAL_CAPACITY;
+  boot_allocation_t* new_table =
+      calloc(new_capacity, sizeof(boot_allocation_t));
+  if (new_table == NULL) {
+    return false;
+  }
+
+  boot_table = new_table;
+  boot_table_capacity = new_capacity;
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old_table[i].ptr != NULL) {
+      boot_table[boot_table_find(old_table[i].ptr)] = old_table[i];
+    }
+  }
+
+  free(old_table);
+  return true;
+}
+
+static size_t boot_size_class(size_t size) {
+  size_t class = 0;
+  while (class < BOOT_SIZE_CLASSES - 1 && ((size_t)1 << class) < size) {
+    class++;
+  }
+  return class;
+}
+
+static void boot_track(void* ptr, size_t size) {
+  // Keep the load factor under 1/2 so probe sequences stay short
+  if ((boot_table_count + 1) * 2 > boot_table_capacity) {
+    if (!boot_table_grow()) {
+      // Unable to grow the tracker, just exit :) same as stack_push
+      exit(1);
+    }
+  }
+
+  size_t i = boot_table_find(ptr);
+  if (boot_table[i].ptr == NULL) {
+    boot_table[i] = (boot_allocation_t){.ptr = ptr, .size = size};
+    boot_table_count++;
+
+    boot_counters.alloc_count++;
+    boot_counters.size_classes[boot_size_class(size)]++;
+    boot_counters.live_bytes += size;
+    if (boot_counters.live_bytes > boot_counters.peak_bytes) {
+      boot_counters.peak_bytes = boot_counters.live_bytes;
+    }
+  }
+}
+
+// Removes the entry at hole, which must be in use
+static void boot_untrack_slot(size_t hole) {
+  size_t mask = boot_table_capacity - 1;
+  size_t size = boot_table[hole].size;
+
+  // Shift the following entries of the probe run back into the hole, so
+  // lookups never need tombstones.
+  size_t i = hole;
+  while (true) {
+    i = (i + 1) & mask;
+    if (boot_table[i].ptr == NULL) {
+      break;
+    }
+
+    size_t home = boot_hash(boot_table[i].ptr, boot_table_capacity);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      boot_table[hole] = boot_table[i];
+      hole = i;
+    }
+  }
+
+  boot_table[hole].ptr = NULL;
+  boot_table_count--;
 
-static Node* allocations = NULL;
+  boot_counters.free_count++;
+  boot_counters.live_bytes -= size;
+}
+
+static void boot_untrack(void* ptr) {
+  if (boot_table_count == 0) {
+    return;
+  }
+
+  size_t hole = boot_table_find(ptr);
+  if (boot_table[hole].ptr != NULL) {
+    boot_untrack_slot(hole);
+  }
+}
 
 void* boot_malloc(size_t size) {
   void* ptr = malloc(size);
   if (!ptr)
     return NULL;
 
-  Node* node = malloc(sizeof(Node));
-  node->ptr = ptr;
-  node->next = allocations;
-  allocations = node;
+  boot_lock_acquire();
+  boot_track(ptr, size);
+  boot_lock_release();
+  return ptr;
+}
+
+void* boot_calloc(size_t count, size_t size) {
+  void* ptr = calloc(count, size);
+  if (!ptr)
+    return NULL;
 
+  boot_lock_acquire();
+  boot_track(ptr, count * size);
+  boot_lock_release();
+  return ptr;
+}
+
+void* boot_realloc(void* ptr, size_t size) {
+  // Held across the call, so no other thread can be handed the old block
+  // before it is untracked.
+  boot_lock_acquire();
+  // Look the old block up while it is still valid, the pointer must not be
+  // touched once realloc has released it.
+  bool tracked = ptr != NULL && boot_table_count != 0;
+  size_t hole = tracked ? boot_table_find(ptr) : 0;
+  tracked = tracked && boot_table[hole].ptr != NULL;
+
+  void* new_ptr = realloc(ptr, size);
+  if (!new_ptr) {
+    boot_lock_release();
+    return NULL;
+  }
+
+  // The old block is only gone once realloc succeeded, a resize counts as
+  // one free plus one allocation of the new size.
+  boot_counters.realloc_count++;
+  if (tracked)
+    boot_untrack_slot(hole);
+  boot_track(new_ptr, size);
+  boot_lock_release();
+  return new_ptr;
+}
+
+void* boot_aligned_alloc(size_t alignment, size_t size) {
+  void* ptr = aligned_alloc(alignment, size);
+  if (!ptr)
+    return NULL;
+
+  boot_lock_acquire();
+  boot_track(ptr, size);
+  boot_lock_release();
   return ptr;
 }
 
@@ -37,22 +235,67 @@ void boot_free(void* ptr) {
   if (!ptr)
     return;
 
-  Node** curr = &allocations;
-  while (*curr) {
-    if ((*curr)->ptr == ptr) {
-      Node* to_free = *curr;
-      *curr = (*curr)->next;
-      free(to_free);
-      break;
-    }
-    curr = &((*curr)->next);
-  }
-
+  boot_lock_acquire();
+  boot_untrack(ptr);
+  boot_lock_release();
   free(ptr);
 }
 
+bool boot_is_freed(void* ptr) {
+  boot_lock_acquire();
+  bool freed = boot_table_count == 0 ||
+               boot_table[boot_table_find(ptr)].ptr == NULL;
+  boot_lock_release();
+  return freed;
+}
+
 bool boot_all_freed(void) {
-  return allocations == NULL;
+  return boot_stats().live_count == 0;
+}
+
+size_t boot_alloc_size(void) {
+  return boot_stats().live_bytes;
+}
+
+size_t boot_realloc_count(void) {
+  return boot_stats().realloc_count;
 }
 
+boot_stats_t boot_stats(void) {
+  boot_lock_acquire();
+  boot_stats_t stats = boot_counters;
+  stats.live_count = boot_table_count;
+  boot_lock_release();
+  return stats;
+}
+
+void boot_stats_dump(void) {
+  boot_stats_t stats = boot_stats();
+
+  printf("live:     %zu bytes in %zu blocks\n", stats.live_bytes,
+         stats.live_count);
+  printf("peak:     %zu bytes\n", stats.peak_bytes);
+  printf("allocs:   %zu\n", stats.alloc_count);
+  printf("frees:    %zu\n", stats.free_count);
+  printf("reallocs: %zu\n", stats.realloc_count);
+  for (size_t i = 0; i < BOOT_SIZE_CLASSES; ++i) {
+    if (stats.size_classes[i] == 0) {
+      continue;
+    }
+    if (i == BOOT_SIZE_CLASSES - 1) {
+      printf("  > %zu: %zu\n", (size_t)1 << (i - 1), stats.size_classes[i]);
+    } else {
+      printf("  <= %zu: %zu\n", (size_t)1 << i, stats.size_classes[i]);
+    }
+  }
+}
+
+// Only redirect the allocator after the tracker itself is defined, so the
+// functions above still reach the real libc allocator.
+#define malloc boot_malloc
+#define calloc boot_calloc
+#define realloc boot_realloc
+#define aligned_alloc boot_aligned_alloc
+#define free boot_free
+
 #endif
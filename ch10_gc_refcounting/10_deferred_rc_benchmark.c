@@ -0,0 +1,517 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// No bootlib here, we want to time the real allocator.
+#include "assert.h"
+
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool logged;  // array already snapshotted in this epoch
+  bool in_zct;  // count hit zero while deferred, waiting for the epoch end
+} snek_object_t;
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+void refcount_defer(bool deferred);
+void refcount_epoch();
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+// Deferred mode (Levanoni & Petrank's coalescing): the first store into an
+// array during an epoch snapshots its elements, later stores just write.
+// At the epoch boundary every changed slot costs one increment of what it
+// holds now and one decrement of what it held at the snapshot, however
+// many times it was overwritten in between. Counts that hit zero meanwhile
+// sit in the zero count table, a slot store may still resurrect them.
+#define REFCOUNT_LOG_MAX (1 << 20)  // snapshotted slots before a forced epoch
+
+typedef struct RefcountLogEntry {
+  snek_object_t* array;
+  snek_object_t** old;
+} refcount_log_entry_t;
+
+typedef struct RefcountLog {
+  bool deferred;
+  size_t count;
+  size_t capacity;
+  refcount_log_entry_t* entries;
+  size_t slots;
+  size_t zct_count;
+  size_t zct_capacity;
+  snek_object_t** zct;
+} refcount_log_t;
+
+static refcount_log_t refcount_log = {0};
+
+void refcount_log_array(snek_object_t* array) {
+  if (refcount_log.count == refcount_log.capacity) {
+    size_t capacity = refcount_log.capacity ? refcount_log.capacity * 2 : 8;
+    refcount_log_entry_t* entries = realloc(
+        refcount_log.entries, capacity * sizeof(refcount_log_entry_t));
+    if (entries == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+    refcount_log.entries = entries;
+    refcount_log.capacity = capacity;
+  }
+
+  size_t size = array->data.v_array.size;
+  snek_object_t** old = malloc(size * sizeof(snek_object_t*));
+  if (old == NULL) {
+    exit(1);
+  }
+  memcpy(old, array->data.v_array.elements, size * sizeof(snek_object_t*));
+
+  refcount_log.entries[refcount_log.count++] =
+      (refcount_log_entry_t){.array = array, .old = old};
+  refcount_log.slots += size;
+  array->logged = true;
+}
+
+void refcount_zct_push(snek_object_t* obj) {
+  if (obj->in_zct) {
+    return;
+  }
+
+  if (refcount_log.zct_count == refcount_log.zct_capacity) {
+    size_t capacity =
+        refcount_log.zct_capacity ? refcount_log.zct_capacity * 2 : 8;
+    snek_object_t** zct =
+        realloc(refcount_log.zct, capacity * sizeof(snek_object_t*));
+    if (zct == NULL) {
+      exit(1);
+    }
+    refcount_log.zct = zct;
+    refcount_log.zct_capacity = capacity;
+  }
+
+  refcount_log.zct[refcount_log.zct_count++] = obj;
+  obj->in_zct = true;
+}
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_obj->kind != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+
+  if (refcount_log.deferred) {
+    if (!snek_obj->logged) {
+      if (refcount_log.slots >= REFCOUNT_LOG_MAX) {
+        refcount_epoch();
+      }
+      refcount_log_array(snek_obj);
+    }
+    snek_obj->data.v_array.elements[index] = value;
+    return true;
+  }
+
+  // Increment first, storing the value a slot already holds must not free it
+  refcount_inc(value);
+  refcount_dec(snek_obj->data.v_array.elements[index]);
+  snek_obj->data.v_array.elements[index] = value;
+  return true;
+}
+
+// Objects whose count hit zero wait here instead of being freed on the spot.
+// Freeing a child only queues it, so releasing a deep chain is a loop over
+// the queue rather than one C stack frame per level. The inline part covers
+// the usual short bursts, longer ones spill into a heap buffer that is
+// released as soon as the queue drains.
+#define FREE_QUEUE_INLINE 64
+
+typedef struct FreeQueue {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+  snek_object_t* inline_data[FREE_QUEUE_INLINE];
+  bool draining;
+} free_queue_t;
+
+static free_queue_t free_queue = {
+    .count = 0,
+    .capacity = FREE_QUEUE_INLINE,
+    .data = free_queue.inline_data,
+    .draining = false,
+};
+
+void free_queue_push(snek_object_t* obj) {
+  if (free_queue.count == free_queue.capacity) {
+    size_t capacity = free_queue.capacity * 2;
+    snek_object_t** data;
+    if (free_queue.data == free_queue.inline_data) {
+      data = malloc(capacity * sizeof(snek_object_t*));
+      if (data != NULL) {
+        memcpy(data, free_queue.inline_data,
+               free_queue.count * sizeof(snek_object_t*));
+      }
+    } else {
+      data = realloc(free_queue.data, capacity * sizeof(snek_object_t*));
+    }
+    if (data == NULL) {
+      // Unable to grow the queue, just exit :) get gud
+      exit(1);
+    }
+    free_queue.data = data;
+    free_queue.capacity = capacity;
+  }
+
+  free_queue.data[free_queue.count++] = obj;
+}
+
+void free_queue_drain() {
+  free_queue.draining = true;
+  // LIFO, so a dying object's children are freed right after it while they
+  // are still in cache
+  while (free_queue.count > 0) {
+    refcount_free(free_queue.data[--free_queue.count]);
+  }
+  free_queue.draining = false;
+
+  if (free_queue.data != free_queue.inline_data) {
+    free(free_queue.data);
+    free_queue.data = free_queue.inline_data;
+    free_queue.capacity = FREE_QUEUE_INLINE;
+  }
+}
+
+void refcount_dec(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    // A slot written this epoch may still hold it
+    if (refcount_log.deferred) {
+      refcount_zct_push(obj);
+      return;
+    }
+    // Still has its own zero count table entry, that one frees it
+    if (obj->in_zct) {
+      return;
+    }
+    free_queue_push(obj);
+    // Only the outermost release drains, nested ones just add to the queue
+    if (!free_queue.draining) {
+      free_queue_drain();
+    }
+  }
+  return;
+}
+
+void refcount_epoch() {
+  if (!refcount_log.deferred) {
+    return;
+  }
+
+  // All increments before any decrement, so an object that merely moved
+  // between slots never touches zero
+  for (size_t i = 0; i < refcount_log.count; ++i) {
+    snek_array_t* array = &refcount_log.entries[i].array->data.v_array;
+    snek_object_t** old = refcount_log.entries[i].old;
+    for (size_t j = 0; j < array->size; ++j) {
+      if (array->elements[j] != old[j]) {
+        refcount_inc(array->elements[j]);
+      }
+    }
+  }
+  for (size_t i = 0; i < refcount_log.count; ++i) {
+    snek_object_t* obj = refcount_log.entries[i].array;
+    snek_object_t** old = refcount_log.entries[i].old;
+    for (size_t j = 0; j < obj->data.v_array.size; ++j) {
+      if (obj->data.v_array.elements[j] != old[j]) {
+        refcount_dec(old[j]);
+      }
+    }
+    obj->logged = false;
+    free(old);
+  }
+  refcount_log.count = 0;
+  refcount_log.slots = 0;
+
+  // Whatever is still at zero now is really dead
+  refcount_log.deferred = false;
+  for (size_t i = 0; i < refcount_log.zct_count; ++i) {
+    snek_object_t* obj = refcount_log.zct[i];
+    obj->in_zct = false;
+    if (obj->refcount == 0) {
+      free_queue_push(obj);
+      free_queue_drain();
+    }
+  }
+  refcount_log.zct_count = 0;
+  refcount_log.deferred = true;
+}
+
+void refcount_defer(bool deferred) {
+  if (!deferred && refcount_log.deferred) {
+    refcount_epoch();
+    free(refcount_log.entries);
+    free(refcount_log.zct);
+    refcount_log = (refcount_log_t){0};
+  }
+  refcount_log.deferred = deferred;
+}
+
+// Only called from free_queue_drain, the children's refcount_dec calls queue
+// them instead of recursing.
+void refcount_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      snek_vector_t vec = obj->data.v_vector3;
+      refcount_dec(vec.x);
+      refcount_dec(vec.y);
+      refcount_dec(vec.z);
+      break;
+    }
+    case ARRAY:
+      for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+        refcount_dec(obj->data.v_array.elements[i]);
+      }
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  free(obj);
+}
+
+// don't touch below this line
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_obj->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  obj->refcount++;
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Benchmark-----------------------------------
+// Rewrite every slot of a large array over and over with a handful of shared
+// integers, the pattern a hot interpreter loop over a list produces.
+#define ARRAY_SIZE (1 << 20)
+#define SHARED_VALUES 16
+#define PASSES 32
+#define PASSES_PER_EPOCH 8
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double rewrite(bool deferred, long* checksum) {
+  snek_object_t* shared[SHARED_VALUES];
+  for (int i = 0; i < SHARED_VALUES; ++i) {
+    shared[i] = new_snek_integer(i);
+  }
+  snek_object_t* array = new_snek_array(ARRAY_SIZE);
+
+  double start = now_seconds();
+  refcount_defer(deferred);
+  for (int pass = 0; pass < PASSES; ++pass) {
+    for (size_t i = 0; i < ARRAY_SIZE; ++i) {
+      snek_array_set(array, i, shared[(i + pass) % SHARED_VALUES]);
+    }
+    if ((pass + 1) % PASSES_PER_EPOCH == 0) {
+      refcount_epoch();
+    }
+  }
+  refcount_defer(false);
+  double elapsed = now_seconds() - start;
+
+  for (int i = 0; i < SHARED_VALUES; ++i) {
+    *checksum += (long)shared[i]->refcount * i;
+  }
+  refcount_dec(array);
+  for (int i = 0; i < SHARED_VALUES; ++i) {
+    refcount_dec(shared[i]);
+  }
+  return elapsed;
+}
+
+int main() {
+  long immediate_checksum = 0;
+  long deferred_checksum = 0;
+
+  double immediate_time = rewrite(false, &immediate_checksum);
+  double deferred_time = rewrite(true, &deferred_checksum);
+
+  if (immediate_checksum != deferred_checksum) {
+    printf("checksum mismatch: %ld != %ld\n", immediate_checksum,
+           deferred_checksum);
+    return 1;
+  }
+
+  long stores = (long)ARRAY_SIZE * PASSES;
+  printf("%d passes over %d slots, epoch every %d passes\n", PASSES,
+         ARRAY_SIZE, PASSES_PER_EPOCH);
+  printf("  immediate: %.3f s (%.2f ns/store)\n", immediate_time,
+         immediate_time * 1e9 / stores);
+  printf("  deferred:  %.3f s (%.2f ns/store)\n", deferred_time,
+         deferred_time * 1e9 / stores);
+  printf("  speedup:   %.2fx\n", immediate_time / deferred_time);
+
+  return 0;
+}
@@ -0,0 +1,826 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+#include "assert.h"
+
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct RefcountThread refcount_thread_t;
+
+// Biased reference counting (Choi, Shull & Torrellas, 2018). The thread that
+// created an object owns it and counts in refcount without atomics, every
+// other thread counts in shared. The low two bits of shared are flags, the
+// count itself sits above them and may go negative while the owner hasn't
+// merged yet.
+#define SHARED_MERGED 1  // owner gave up its bias, only shared counts
+#define SHARED_QUEUED 2  // waiting in the owner's queue for a merge
+#define SHARED_FLAGS 3
+#define SHARED_ONE 4
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  _Atomic(refcount_thread_t*) owner;  // NULL once merged
+  atomic_long shared;
+} snek_object_t;
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+void refcount_thread_attach();
+void refcount_thread_detach();
+void refcount_thread_merge_queue();
+void refcount_threads_free();
+void refcount_dec_shared(snek_object_t* obj);
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_obj->kind != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+  // Increment first, storing the value a slot already holds must not free it
+  refcount_inc(value);
+  refcount_dec(snek_obj->data.v_array.elements[index]);
+  snek_obj->data.v_array.elements[index] = value;
+  return true;
+}
+
+// Objects whose count hit zero wait here instead of being freed on the spot.
+// Freeing a child only queues it, so releasing a deep chain is a loop over
+// the queue rather than one C stack frame per level. The inline part covers
+// the usual short bursts, longer ones spill into a heap buffer that is
+// released as soon as the queue drains.
+#define FREE_QUEUE_INLINE 64
+
+typedef struct FreeQueue {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+  snek_object_t* inline_data[FREE_QUEUE_INLINE];
+  bool draining;
+} free_queue_t;
+
+// Per thread, whichever thread drops the last reference frees the object.
+// The inline buffer's address isn't a constant for a thread-local, so an
+// empty data pointer stands for it.
+static _Thread_local free_queue_t free_queue = {0};
+
+void free_queue_push(snek_object_t* obj) {
+  if (free_queue.data == NULL) {
+    free_queue.data = free_queue.inline_data;
+    free_queue.capacity = FREE_QUEUE_INLINE;
+  }
+  if (free_queue.count == free_queue.capacity) {
+    size_t capacity = free_queue.capacity * 2;
+    snek_object_t** data;
+    if (free_queue.data == free_queue.inline_data) {
+      data = malloc(capacity * sizeof(snek_object_t*));
+      if (data != NULL) {
+        memcpy(data, free_queue.inline_data,
+               free_queue.count * sizeof(snek_object_t*));
+      }
+    } else {
+      data = realloc(free_queue.data, capacity * sizeof(snek_object_t*));
+    }
+    if (data == NULL) {
+      // Unable to grow the queue, just exit :) get gud
+      exit(1);
+    }
+    free_queue.data = data;
+    free_queue.capacity = capacity;
+  }
+
+  free_queue.data[free_queue.count++] = obj;
+}
+
+void free_queue_drain() {
+  free_queue.draining = true;
+  // LIFO, so a dying object's children are freed right after it while they
+  // are still in cache
+  while (free_queue.count > 0) {
+    refcount_free(free_queue.data[--free_queue.count]);
+  }
+  free_queue.draining = false;
+
+  if (free_queue.data != free_queue.inline_data) {
+    free(free_queue.data);
+    free_queue.data = NULL;
+    free_queue.capacity = 0;
+  }
+}
+
+void refcount_release(snek_object_t* obj) {
+  free_queue_push(obj);
+  // Only the outermost release drains, nested ones just add to the queue
+  if (!free_queue.draining) {
+    free_queue_drain();
+  }
+}
+
+// Objects another thread over-released, the owner merges them. A thread
+// that never attaches counts as the main thread.
+typedef struct RefcountThread {
+  pthread_mutex_t lock;
+  size_t count;
+  size_t capacity;
+  snek_object_t** queue;
+  bool detached;
+  struct RefcountThread* next;
+} refcount_thread_t;
+
+static refcount_thread_t refcount_main_thread = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static _Thread_local refcount_thread_t* refcount_thread =
+    &refcount_main_thread;
+
+// Objects can outlive the thread that owns them, so detached threads are
+// kept around until refcount_threads_free.
+static pthread_mutex_t refcount_detached_lock = PTHREAD_MUTEX_INITIALIZER;
+static refcount_thread_t* refcount_detached_threads = NULL;
+
+void refcount_thread_attach() {
+  refcount_thread_t* thread = calloc(1, sizeof(refcount_thread_t));
+  if (thread == NULL) {
+    exit(1);
+  }
+  pthread_mutex_init(&thread->lock, NULL);
+  refcount_thread = thread;
+}
+
+// Give up the bias for good. Only the owner, or anyone once the owner has
+// detached, may read its count.
+void refcount_merge_queued(snek_object_t* obj) {
+  if (atomic_load_explicit(&obj->owner, memory_order_relaxed) == NULL) {
+    // Merged in the meantime, just apply the pending decrement
+    refcount_dec_shared(obj);
+    return;
+  }
+
+  atomic_store_explicit(&obj->owner, NULL, memory_order_relaxed);
+  long local = (long)obj->refcount - 1;  // the pending decrement included
+  obj->refcount = 0;
+  long old = atomic_load_explicit(&obj->shared, memory_order_acquire);
+  long new;
+  do {
+    new = ((old & ~SHARED_FLAGS) + local * SHARED_ONE) | SHARED_MERGED;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &obj->shared, &old, new, memory_order_acq_rel, memory_order_acquire));
+
+  if (new == SHARED_MERGED) {
+    refcount_release(obj);
+  }
+}
+
+void refcount_thread_merge_queue() {
+  refcount_thread_t* thread = refcount_thread;
+
+  pthread_mutex_lock(&thread->lock);
+  snek_object_t** queue = thread->queue;
+  size_t count = thread->count;
+  thread->queue = NULL;
+  thread->count = 0;
+  thread->capacity = 0;
+  pthread_mutex_unlock(&thread->lock);
+
+  for (size_t i = 0; i < count; ++i) {
+    refcount_merge_queued(queue[i]);
+  }
+  free(queue);
+}
+
+// Objects the thread still owns stay biased towards it, whoever
+// over-releases one later merges it on the spot.
+void refcount_thread_detach() {
+  refcount_thread_t* thread = refcount_thread;
+  if (thread == &refcount_main_thread) {
+    return;
+  }
+
+  pthread_mutex_lock(&thread->lock);
+  thread->detached = true;
+  pthread_mutex_unlock(&thread->lock);
+  refcount_thread_merge_queue();
+
+  pthread_mutex_lock(&refcount_detached_lock);
+  thread->next = refcount_detached_threads;
+  refcount_detached_threads = thread;
+  pthread_mutex_unlock(&refcount_detached_lock);
+  refcount_thread = &refcount_main_thread;
+}
+
+void refcount_threads_free() {
+  pthread_mutex_lock(&refcount_detached_lock);
+  refcount_thread_t* thread = refcount_detached_threads;
+  refcount_detached_threads = NULL;
+  pthread_mutex_unlock(&refcount_detached_lock);
+
+  while (thread != NULL) {
+    refcount_thread_t* next = thread->next;
+    pthread_mutex_destroy(&thread->lock);
+    free(thread);
+    thread = next;
+  }
+}
+
+void refcount_thread_queue(refcount_thread_t* thread, snek_object_t* obj) {
+  pthread_mutex_lock(&thread->lock);
+  if (thread->detached) {
+    pthread_mutex_unlock(&thread->lock);
+    refcount_merge_queued(obj);
+    return;
+  }
+
+  if (thread->count == thread->capacity) {
+    size_t capacity = thread->capacity ? thread->capacity * 2 : 8;
+    snek_object_t** queue =
+        realloc(thread->queue, capacity * sizeof(snek_object_t*));
+    if (queue == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+    thread->queue = queue;
+    thread->capacity = capacity;
+  }
+  thread->queue[thread->count++] = obj;
+  pthread_mutex_unlock(&thread->lock);
+}
+
+void refcount_dec_shared(snek_object_t* obj) {
+  long old = atomic_load_explicit(&obj->shared, memory_order_relaxed);
+  long new;
+  bool queue;
+  do {
+    // Going below zero before the merge, the owner may still hold the
+    // bias. Keep the reference and hand the decrement to the owner instead.
+    queue = old == 0;
+    new = queue ? SHARED_QUEUED : old - SHARED_ONE;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &obj->shared, &old, new, memory_order_acq_rel, memory_order_relaxed));
+
+  if (queue) {
+    refcount_thread_queue(atomic_load(&obj->owner), obj);
+    return;
+  }
+  if (new == SHARED_MERGED) {
+    refcount_release(obj);
+  }
+}
+
+// The owner's own count hit zero, fold it into the shared count
+void refcount_merge_zero(snek_object_t* obj) {
+  long old = atomic_load_explicit(&obj->shared, memory_order_acquire);
+  if (old == 0) {
+    refcount_release(obj);
+    return;
+  }
+
+  atomic_store_explicit(&obj->owner, NULL, memory_order_relaxed);
+  long new;
+  do {
+    // Still queued means a decrement is pending, the count stays above zero
+    // until the owner applies it from its queue
+    new = (old & ~SHARED_FLAGS) | SHARED_MERGED;
+  } while (!atomic_compare_exchange_weak_explicit(
+      &obj->shared, &old, new, memory_order_acq_rel, memory_order_acquire));
+
+  if (new == SHARED_MERGED) {
+    refcount_release(obj);
+  }
+}
+
+void refcount_dec(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  if (atomic_load_explicit(&obj->owner, memory_order_relaxed) !=
+      refcount_thread) {
+    refcount_dec_shared(obj);
+    return;
+  }
+
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    refcount_merge_zero(obj);
+  }
+  return;
+}
+
+// Only called from free_queue_drain, the children's refcount_dec calls queue
+// them instead of recursing.
+void refcount_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      snek_vector_t vec = obj->data.v_vector3;
+      refcount_dec(vec.x);
+      refcount_dec(vec.y);
+      refcount_dec(vec.z);
+      break;
+    }
+    case ARRAY:
+      for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+        refcount_dec(obj->data.v_array.elements[i]);
+      }
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  free(obj);
+}
+
+// don't touch below this line
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_obj->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  if (atomic_load_explicit(&obj->owner, memory_order_relaxed) !=
+      refcount_thread) {
+    atomic_fetch_add_explicit(&obj->shared, SHARED_ONE, memory_order_relaxed);
+    return;
+  }
+
+  obj->refcount++;
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+  atomic_init(&obj->owner, refcount_thread);
+  atomic_init(&obj->shared, 0);
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+
+static MunitResult test_array_set(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* array = new_snek_array(1);
+
+  snek_array_set(array, 0, foo);
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(foo);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_free(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* array = new_snek_array(2);
+
+  snek_array_set(array, 0, foo);
+  snek_array_set(array, 1, bar);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 1);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  snek_array_set(array, 0, baz);
+  munit_assert_true(boot_is_freed(foo));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_refcounting(const MunitParameter params[],
+                                            void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* vec = new_snek_vector3(foo, bar, baz);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 2);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(vec);
+  munit_assert_true(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(bar));
+  munit_assert_false(boot_is_freed(baz));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_int_has_refcount(const MunitParameter params[],
+                                         void* data) {
+  snek_object_t* obj = new_snek_integer(10);
+  munit_assert_int(obj->refcount, ==, 1);
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_inc_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_dec_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_false(boot_is_freed(obj));
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_refcount_free_is_called(const MunitParameter params[],
+                                                void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_allocated_string_is_freed(const MunitParameter params[],
+                                                  void* data) {
+  snek_object_t* obj = new_snek_string("Hello @wagslane!");
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_string_equal(obj->data.v_string, "Hello @wagslane!");
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_wide_array_spills(const MunitParameter params[],
+                                          void* data) {
+  // More children die at once than the inline queue holds
+  snek_object_t* array = new_snek_array(FREE_QUEUE_INLINE * 4);
+  for (size_t i = 0; i < FREE_QUEUE_INLINE * 4; ++i) {
+    snek_object_t* value = new_snek_string("spill");
+    snek_array_set(array, i, value);
+    refcount_dec(value);
+  }
+
+  refcount_dec(array);
+  munit_assert_true(boot_is_freed(array));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+#define WORKERS 4
+
+static void* worker_churn(void* data) {
+  snek_object_t* array = data;
+
+  refcount_thread_attach();
+  for (int i = 0; i < 10000; ++i) {
+    snek_object_t* value = snek_array_get(array, 0);
+    refcount_inc(value);
+    refcount_inc(array);
+    refcount_dec(array);
+    refcount_dec(value);
+  }
+  refcount_thread_detach();
+  return NULL;
+}
+
+static MunitResult test_shared_across_threads(const MunitParameter params[],
+                                              void* data) {
+  snek_object_t* array = new_snek_array(1);
+  snek_object_t* name = new_snek_string("shared");
+  snek_array_set(array, 0, name);
+  refcount_dec(name);
+
+  pthread_t workers[WORKERS];
+  for (int i = 0; i < WORKERS; ++i) {
+    pthread_create(&workers[i], NULL, worker_churn, array);
+  }
+  for (int i = 0; i < WORKERS; ++i) {
+    pthread_join(workers[i], NULL);
+  }
+
+  // The workers only ever touched the shared count, and left it balanced
+  munit_assert_int(array->refcount, ==, 1);
+  munit_assert_long(atomic_load(&array->shared), ==, 0);
+  munit_assert_long(atomic_load(&name->shared), ==, 0);
+
+  refcount_dec(array);
+  refcount_threads_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static void* worker_release(void* data) {
+  refcount_thread_attach();
+  refcount_dec(data);
+  refcount_thread_detach();
+  return NULL;
+}
+
+static MunitResult test_worker_frees_after_merge(const MunitParameter params[],
+                                                 void* data) {
+  snek_object_t* obj = new_snek_string("last one out");
+
+  // Taken on this thread's behalf but released on the worker's
+  atomic_fetch_add(&obj->shared, SHARED_ONE);
+  refcount_dec(obj);
+  munit_assert_false(boot_is_freed(obj));
+  munit_assert_long(atomic_load(&obj->shared), ==, SHARED_ONE | SHARED_MERGED);
+
+  pthread_t worker;
+  pthread_create(&worker, NULL, worker_release, obj);
+  pthread_join(worker, NULL);
+  munit_assert_true(boot_is_freed(obj));
+
+  refcount_threads_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_handoff_is_queued(const MunitParameter params[],
+                                          void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  // Hand our only reference to a worker, its decrement would take the
+  // shared count below zero so the owner gets to merge it instead
+  pthread_t worker;
+  pthread_create(&worker, NULL, worker_release, obj);
+  pthread_join(worker, NULL);
+  munit_assert_false(boot_is_freed(obj));
+  munit_assert_long(atomic_load(&obj->shared), ==, SHARED_QUEUED);
+
+  refcount_thread_merge_queue();
+  munit_assert_true(boot_is_freed(obj));
+
+  refcount_threads_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static void* worker_produce(void* data) {
+  snek_object_t* array = data;
+
+  refcount_thread_attach();
+  snek_object_t* value = new_snek_integer(42);
+  snek_array_set(array, 0, value);
+  refcount_dec(value);
+  refcount_thread_detach();
+  return NULL;
+}
+
+static MunitResult test_owner_detached(const MunitParameter params[],
+                                       void* data) {
+  snek_object_t* array = new_snek_array(1);
+
+  pthread_t worker;
+  pthread_create(&worker, NULL, worker_produce, array);
+  pthread_join(worker, NULL);
+
+  // The integer is still biased towards the gone worker, releasing the
+  // array merges it right here
+  snek_object_t* value = snek_array_get(array, 0);
+  munit_assert_int(value->data.v_int, ==, 42);
+  refcount_dec(array);
+  munit_assert_true(boot_is_freed(value));
+
+  refcount_threads_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/array_set", test_array_set, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/array_free", test_array_free, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/has_refcount", test_int_has_refcount, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/inc_refcount", test_inc_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/dec_refcount", test_dec_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/free_refcount", test_refcount_free_is_called, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/string_freed", test_allocated_string_is_freed, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/vector3", test_vector3_refcounting, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/wide_array_spills", test_wide_array_spills, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/shared_across_threads", test_shared_across_threads, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/worker_frees_after_merge", test_worker_frees_after_merge, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/handoff_is_queued", test_handoff_is_queued, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/owner_detached", test_owner_detached, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {"/refcount", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE};
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
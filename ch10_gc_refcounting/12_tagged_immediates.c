@@ -0,0 +1,589 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+#include "assert.h"
+
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+// Integers and floats live in the pointer word itself. Heap objects are at
+// least 8 byte aligned, so a pointer with the low bit set can't be one of
+// them. The low three bits say which kind of immediate it is, the 32 bit
+// payload sits in the upper half. Every snek int and float fits, nothing
+// numeric is ever boxed on the heap.
+_Static_assert(sizeof(uintptr_t) == 8, "immediates need 64 bit pointers");
+
+#define SNEK_TAG_MASK 7
+#define SNEK_TAG_INT 1
+#define SNEK_TAG_FLOAT 3
+
+bool snek_is_immediate(snek_object_t* obj) {
+  return ((uintptr_t)obj & 1) != 0;
+}
+
+bool snek_is_int(snek_object_t* obj) {
+  return ((uintptr_t)obj & SNEK_TAG_MASK) == SNEK_TAG_INT;
+}
+
+bool snek_is_float(snek_object_t* obj) {
+  return ((uintptr_t)obj & SNEK_TAG_MASK) == SNEK_TAG_FLOAT;
+}
+
+snek_object_t* snek_box_int(int value) {
+  return (snek_object_t*)(((uintptr_t)(uint32_t)value << 32) | SNEK_TAG_INT);
+}
+
+int snek_unbox_int(snek_object_t* obj) {
+  return (int)(uint32_t)((uintptr_t)obj >> 32);
+}
+
+snek_object_t* snek_box_float(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return (snek_object_t*)(((uintptr_t)bits << 32) | SNEK_TAG_FLOAT);
+}
+
+float snek_unbox_float(snek_object_t* obj) {
+  uint32_t bits = (uint32_t)((uintptr_t)obj >> 32);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Use instead of obj->kind wherever obj might be an immediate
+snek_object_kind_t snek_kind(snek_object_t* obj) {
+  if (snek_is_int(obj)) {
+    return INTEGER;
+  }
+  if (snek_is_float(obj)) {
+    return FLOAT;
+  }
+  return obj->kind;
+}
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+int snek_length(snek_object_t* obj);
+snek_object_t* snek_add(snek_object_t* a, snek_object_t* b);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_kind(snek_obj) != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+  // Increment first, storing the value a slot already holds must not free it
+  refcount_inc(value);
+  refcount_dec(snek_obj->data.v_array.elements[index]);
+  snek_obj->data.v_array.elements[index] = value;
+  return true;
+}
+
+// Objects whose count hit zero wait here instead of being freed on the spot.
+// Freeing a child only queues it, so releasing a deep chain is a loop over
+// the queue rather than one C stack frame per level. The inline part covers
+// the usual short bursts, longer ones spill into a heap buffer that is
+// released as soon as the queue drains.
+#define FREE_QUEUE_INLINE 64
+
+typedef struct FreeQueue {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+  snek_object_t* inline_data[FREE_QUEUE_INLINE];
+  bool draining;
+} free_queue_t;
+
+static free_queue_t free_queue = {
+    .count = 0,
+    .capacity = FREE_QUEUE_INLINE,
+    .data = free_queue.inline_data,
+    .draining = false,
+};
+
+void free_queue_push(snek_object_t* obj) {
+  if (free_queue.count == free_queue.capacity) {
+    size_t capacity = free_queue.capacity * 2;
+    snek_object_t** data;
+    if (free_queue.data == free_queue.inline_data) {
+      data = malloc(capacity * sizeof(snek_object_t*));
+      if (data != NULL) {
+        memcpy(data, free_queue.inline_data,
+               free_queue.count * sizeof(snek_object_t*));
+      }
+    } else {
+      data = realloc(free_queue.data, capacity * sizeof(snek_object_t*));
+    }
+    if (data == NULL) {
+      // Unable to grow the queue, just exit :) get gud
+      exit(1);
+    }
+    free_queue.data = data;
+    free_queue.capacity = capacity;
+  }
+
+  free_queue.data[free_queue.count++] = obj;
+}
+
+void free_queue_drain() {
+  free_queue.draining = true;
+  // LIFO, so a dying object's children are freed right after it while they
+  // are still in cache
+  while (free_queue.count > 0) {
+    refcount_free(free_queue.data[--free_queue.count]);
+  }
+  free_queue.draining = false;
+
+  if (free_queue.data != free_queue.inline_data) {
+    free(free_queue.data);
+    free_queue.data = free_queue.inline_data;
+    free_queue.capacity = FREE_QUEUE_INLINE;
+  }
+}
+
+void refcount_dec(snek_object_t* obj) {
+  // Immediates aren't counted, they die with the word that holds them
+  if (obj == NULL || snek_is_immediate(obj)) {
+    return;
+  }
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    free_queue_push(obj);
+    // Only the outermost release drains, nested ones just add to the queue
+    if (!free_queue.draining) {
+      free_queue_drain();
+    }
+  }
+  return;
+}
+
+// Only called from free_queue_drain, the children's refcount_dec calls queue
+// them instead of recursing.
+void refcount_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      snek_vector_t vec = obj->data.v_vector3;
+      refcount_dec(vec.x);
+      refcount_dec(vec.y);
+      refcount_dec(vec.z);
+      break;
+    }
+    case ARRAY:
+      for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+        refcount_dec(obj->data.v_array.elements[i]);
+      }
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  free(obj);
+}
+
+int snek_length(snek_object_t* obj) {
+  if (obj == NULL) {
+    return -1;
+  }
+
+  switch (snek_kind(obj)) {
+    case INTEGER:
+    case FLOAT:
+      return 1;
+    case STRING:
+      return strlen(obj->data.v_string);
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    default:
+      return -1;
+  }
+}
+
+// Numbers never allocate, mixed int and float adds promote to float. The
+// result is a new reference, like every constructor's.
+snek_object_t* snek_add(snek_object_t* a, snek_object_t* b) {
+  if (!a || !b) {
+    return NULL;
+  }
+
+  switch (snek_kind(a)) {
+    case INTEGER:
+      switch (snek_kind(b)) {
+        case INTEGER:
+          return snek_box_int(snek_unbox_int(a) + snek_unbox_int(b));
+        case FLOAT:
+          return snek_box_float(snek_unbox_int(a) + snek_unbox_float(b));
+        default:
+          return NULL;
+      }
+
+    case FLOAT:
+      switch (snek_kind(b)) {
+        case INTEGER:
+          return snek_box_float(snek_unbox_float(a) + snek_unbox_int(b));
+        case FLOAT:
+          return snek_box_float(snek_unbox_float(a) + snek_unbox_float(b));
+        default:
+          return NULL;
+      }
+
+    case STRING: {
+      if (snek_kind(b) != STRING) {
+        return NULL;
+      }
+
+      // +1 for null terminator
+      int new_len = strlen(a->data.v_string) + strlen(b->data.v_string) + 1;
+      char* tmp = calloc(sizeof(char), new_len);
+      if (tmp == NULL) {
+        return NULL;
+      }
+
+      strcat(tmp, a->data.v_string);
+      strcat(tmp, b->data.v_string);
+
+      snek_object_t* obj = new_snek_string(tmp);
+      free(tmp);
+      return obj;
+    }
+
+    case VECTOR3: {
+      if (snek_kind(b) != VECTOR3) {
+        return NULL;
+      }
+
+      snek_object_t* x = snek_add(a->data.v_vector3.x, b->data.v_vector3.x);
+      snek_object_t* y = snek_add(a->data.v_vector3.y, b->data.v_vector3.y);
+      snek_object_t* z = snek_add(a->data.v_vector3.z, b->data.v_vector3.z);
+      snek_object_t* obj = new_snek_vector3(x, y, z);
+      // The vector took its own references
+      refcount_dec(x);
+      refcount_dec(y);
+      refcount_dec(z);
+      return obj;
+    }
+
+    case ARRAY: {
+      if (snek_kind(b) != ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_array.size;
+      size_t b_len = b->data.v_array.size;
+      snek_object_t* arr = new_snek_array(a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      for (size_t i = 0; i < a_len; ++i) {
+        snek_array_set(arr, i, snek_array_get(a, i));
+      }
+      for (size_t i = 0; i < b_len; ++i) {
+        snek_array_set(arr, a_len + i, snek_array_get(b, i));
+      }
+      return arr;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+// don't touch below this line
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_kind(snek_obj) != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL || snek_is_immediate(obj)) {
+    return;
+  }
+
+  obj->refcount++;
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  return snek_box_int(value);
+}
+
+snek_object_t* new_snek_float(float value) {
+  return snek_box_float(value);
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+
+static MunitResult test_box_unbox(const MunitParameter params[], void* data) {
+  int ints[] = {0, 1, -1, 42, 2147483647, -2147483647 - 1};
+  for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+    snek_object_t* obj = snek_box_int(ints[i]);
+    munit_assert_true(snek_is_int(obj));
+    munit_assert_int(snek_unbox_int(obj), ==, ints[i]);
+  }
+
+  float floats[] = {0.0f, -0.0f, 1.5f, -3.25f, 1e30f};
+  for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i) {
+    snek_object_t* obj = snek_box_float(floats[i]);
+    munit_assert_true(snek_is_float(obj));
+    munit_assert_float(snek_unbox_float(obj), ==, floats[i]);
+  }
+
+  snek_object_t* s = new_snek_string("boxed");
+  munit_assert_false(snek_is_immediate(s));
+  munit_assert_int(snek_kind(s), ==, STRING);
+  refcount_dec(s);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_numbers_allocate_nothing(const MunitParameter params[],
+                                                 void* data) {
+  boot_stats_t before = boot_stats();
+
+  snek_object_t* sum = new_snek_integer(0);
+  for (int i = 0; i < 1000; ++i) {
+    snek_object_t* next = snek_add(sum, new_snek_integer(i));
+    refcount_dec(sum);
+    sum = next;
+  }
+  snek_object_t* mixed = snek_add(sum, new_snek_float(0.5));
+
+  munit_assert_int(snek_unbox_int(sum), ==, 499500);
+  munit_assert_int(snek_kind(mixed), ==, FLOAT);
+  munit_assert_float(snek_unbox_float(mixed), ==, 499500.5f);
+  munit_assert_int(snek_length(mixed), ==, 1);
+
+  // Counting an immediate is a no-op
+  refcount_inc(sum);
+  refcount_dec(sum);
+  refcount_dec(sum);
+
+  munit_assert_size(boot_stats().alloc_count, ==, before.alloc_count);
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_add(const MunitParameter params[], void* data) {
+  snek_object_t* v1 = new_snek_vector3(
+      new_snek_float(1.0), new_snek_integer(2), new_snek_float(3.0));
+  snek_object_t* v2 = new_snek_vector3(
+      new_snek_float(4.0), new_snek_integer(5), new_snek_integer(6));
+  snek_object_t* v3 = snek_add(v1, v2);
+
+  munit_assert_int(snek_kind(v3), ==, VECTOR3);
+  munit_assert_int(v3->refcount, ==, 1);
+  munit_assert_float(snek_unbox_float(v3->data.v_vector3.x), ==, 5.0f);
+  munit_assert_int(snek_unbox_int(v3->data.v_vector3.y), ==, 7);
+  munit_assert_float(snek_unbox_float(v3->data.v_vector3.z), ==, 9.0f);
+
+  refcount_dec(v1);
+  refcount_dec(v2);
+  refcount_dec(v3);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_nested_vector3_add(const MunitParameter params[],
+                                           void* data) {
+  snek_object_t* one = new_snek_integer(1);
+  snek_object_t* inner = new_snek_vector3(one, one, one);
+  snek_object_t* outer = new_snek_vector3(inner, inner, one);
+  snek_object_t* sum = snek_add(outer, outer);
+
+  snek_object_t* x = sum->data.v_vector3.x;
+  munit_assert_int(x->refcount, ==, 1);
+  munit_assert_int(snek_unbox_int(x->data.v_vector3.z), ==, 2);
+  munit_assert_int(snek_unbox_int(sum->data.v_vector3.z), ==, 2);
+
+  refcount_dec(inner);
+  refcount_dec(outer);
+  refcount_dec(sum);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_string_and_array_add(const MunitParameter params[],
+                                             void* data) {
+  snek_object_t* hello = new_snek_string("hello");
+  snek_object_t* world = new_snek_string(", world");
+  snek_object_t* greeting = snek_add(hello, world);
+  munit_assert_string_equal(greeting->data.v_string, "hello, world");
+  munit_assert_int(snek_length(greeting), ==, 12);
+
+  snek_object_t* mixed = new_snek_array(2);
+  snek_array_set(mixed, 0, new_snek_integer(1));
+  snek_array_set(mixed, 1, greeting);
+  snek_object_t* twice = snek_add(mixed, mixed);
+  munit_assert_int(snek_length(twice), ==, 4);
+  munit_assert_int(snek_unbox_int(snek_array_get(twice, 2)), ==, 1);
+  munit_assert_int(greeting->refcount, ==, 4);
+
+  refcount_dec(hello);
+  refcount_dec(world);
+  refcount_dec(greeting);
+  refcount_dec(mixed);
+  munit_assert_false(boot_is_freed(greeting));
+  refcount_dec(twice);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/box_unbox", test_box_unbox, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/numbers_allocate_nothing", test_numbers_allocate_nothing, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/vector3_add", test_vector3_add, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/nested_vector3_add", test_nested_vector3_add, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/string_and_array_add", test_string_and_array_add, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {"/refcount", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE};
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "../munit/munit.h"
+#include "../bootlib.h"
 #include "assert.h"
 
 typedef struct SnekObject snek_object_t;
@@ -92,7 +93,7 @@ void refcount_free(snek_object_t* obj) {
         refcount_dec(obj->data.v_array.elements[i]);
       }
       free(obj->data.v_array.elements);
-      return;
+      break;
     default:
       assert(false);
   }
@@ -231,11 +232,11 @@ static MunitResult test_array_set(const MunitParameter params[], void* data) {
 
   snek_array_set(array, 0, foo);
   munit_assert_int(foo->refcount, ==, 2);
-  // munit_assert_false(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(foo));
 
   refcount_dec(foo);
   refcount_dec(array);
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -254,15 +255,15 @@ static MunitResult test_array_free(const MunitParameter params[], void* data) {
   munit_assert_int(baz->refcount, ==, 1);
 
   refcount_dec(foo);
-  // munit_assert_false(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(foo));
 
   snek_array_set(array, 0, baz);
-  // munit_assert_true(boot_is_freed(foo));
+  munit_assert_true(boot_is_freed(foo));
 
   refcount_dec(bar);
   refcount_dec(baz);
   refcount_dec(array);
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -279,16 +280,16 @@ static MunitResult test_vector3_refcounting(const MunitParameter params[],
   munit_assert_int(baz->refcount, ==, 2);
 
   refcount_dec(foo);
-  // munit_assert_false(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(foo));
 
   refcount_dec(vec);
-  // munit_assert_true(boot_is_freed(foo));
-  // munit_assert_false(boot_is_freed(bar));
-  // munit_assert_false(boot_is_freed(baz));
+  munit_assert_true(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(bar));
+  munit_assert_false(boot_is_freed(baz));
 
   refcount_dec(bar);
   refcount_dec(baz);
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -322,7 +323,7 @@ static MunitResult test_dec_refcount(const MunitParameter params[],
 
   refcount_dec(obj);
   munit_assert_int(obj->refcount, ==, 1);
-  // munit_assert_false(boot_is_freed(obj));
+  munit_assert_false(boot_is_freed(obj));
 
   free(obj);
   return MUNIT_OK;
@@ -339,8 +340,8 @@ static MunitResult test_refcount_free_is_called(const MunitParameter params[],
   munit_assert_int(obj->refcount, ==, 1);
 
   refcount_dec(obj);
-  // munit_assert_true(boot_is_freed(obj));
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -357,8 +358,8 @@ static MunitResult test_allocated_string_is_freed(const MunitParameter params[],
   munit_assert_string_equal(obj->data.v_string, "Hello @wagslane!");
 
   refcount_dec(obj);
-  // munit_assert_true(boot_is_freed(obj));
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
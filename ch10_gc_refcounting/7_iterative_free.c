@@ -0,0 +1,514 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+#include "assert.h"
+
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_obj->kind != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+  refcount_dec(snek_obj->data.v_array.elements[index]);
+  snek_obj->data.v_array.elements[index] = value;
+  refcount_inc(value);
+  return true;
+}
+
+// Objects whose count hit zero wait here instead of being freed on the spot.
+// Freeing a child only queues it, so releasing a deep chain is a loop over
+// the queue rather than one C stack frame per level. The inline part covers
+// the usual short bursts, longer ones spill into a heap buffer that is
+// released as soon as the queue drains.
+#define FREE_QUEUE_INLINE 64
+
+typedef struct FreeQueue {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+  snek_object_t* inline_data[FREE_QUEUE_INLINE];
+  bool draining;
+} free_queue_t;
+
+static free_queue_t free_queue = {
+    .count = 0,
+    .capacity = FREE_QUEUE_INLINE,
+    .data = free_queue.inline_data,
+    .draining = false,
+};
+
+void free_queue_push(snek_object_t* obj) {
+  if (free_queue.count == free_queue.capacity) {
+    size_t capacity = free_queue.capacity * 2;
+    snek_object_t** data;
+    if (free_queue.data == free_queue.inline_data) {
+      data = malloc(capacity * sizeof(snek_object_t*));
+      if (data != NULL) {
+        memcpy(data, free_queue.inline_data,
+               free_queue.count * sizeof(snek_object_t*));
+      }
+    } else {
+      data = realloc(free_queue.data, capacity * sizeof(snek_object_t*));
+    }
+    if (data == NULL) {
+      // Unable to grow the queue, just exit :) get gud
+      exit(1);
+    }
+    free_queue.data = data;
+    free_queue.capacity = capacity;
+  }
+
+  free_queue.data[free_queue.count++] = obj;
+}
+
+void free_queue_drain() {
+  free_queue.draining = true;
+  // LIFO, so a dying object's children are freed right after it while they
+  // are still in cache
+  while (free_queue.count > 0) {
+    refcount_free(free_queue.data[--free_queue.count]);
+  }
+  free_queue.draining = false;
+
+  if (free_queue.data != free_queue.inline_data) {
+    free(free_queue.data);
+    free_queue.data = free_queue.inline_data;
+    free_queue.capacity = FREE_QUEUE_INLINE;
+  }
+}
+
+void refcount_dec(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    free_queue_push(obj);
+    // Only the outermost release drains, nested ones just add to the queue
+    if (!free_queue.draining) {
+      free_queue_drain();
+    }
+  }
+  return;
+}
+
+// Only called from free_queue_drain, the children's refcount_dec calls queue
+// them instead of recursing.
+void refcount_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      snek_vector_t vec = obj->data.v_vector3;
+      refcount_dec(vec.x);
+      refcount_dec(vec.y);
+      refcount_dec(vec.z);
+      break;
+    }
+    case ARRAY:
+      for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+        refcount_dec(obj->data.v_array.elements[i]);
+      }
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  free(obj);
+}
+
+// don't touch below this line
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_obj->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  obj->refcount++;
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+
+static MunitResult test_array_set(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* array = new_snek_array(1);
+
+  snek_array_set(array, 0, foo);
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(foo);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_free(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* array = new_snek_array(2);
+
+  snek_array_set(array, 0, foo);
+  snek_array_set(array, 1, bar);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 1);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  snek_array_set(array, 0, baz);
+  munit_assert_true(boot_is_freed(foo));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_refcounting(const MunitParameter params[],
+                                            void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* vec = new_snek_vector3(foo, bar, baz);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 2);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(vec);
+  munit_assert_true(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(bar));
+  munit_assert_false(boot_is_freed(baz));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_int_has_refcount(const MunitParameter params[],
+                                         void* data) {
+  snek_object_t* obj = new_snek_integer(10);
+  munit_assert_int(obj->refcount, ==, 1);
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_inc_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_dec_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_false(boot_is_freed(obj));
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_refcount_free_is_called(const MunitParameter params[],
+                                                void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_allocated_string_is_freed(const MunitParameter params[],
+                                                  void* data) {
+  snek_object_t* obj = new_snek_string("Hello @wagslane!");
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_string_equal(obj->data.v_string, "Hello @wagslane!");
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_deep_vector_chain(const MunitParameter params[],
+                                          void* data) {
+  // Deep enough to blow the C stack if every level were a recursive call
+  snek_object_t* zero = new_snek_integer(0);
+  snek_object_t* head = new_snek_vector3(zero, zero, zero);
+  for (int i = 0; i < 1000000; ++i) {
+    snek_object_t* next = new_snek_vector3(head, zero, zero);
+    refcount_dec(head);
+    head = next;
+  }
+  refcount_dec(zero);
+
+  refcount_dec(head);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_deep_array_chain(const MunitParameter params[],
+                                         void* data) {
+  snek_object_t* head = new_snek_array(1);
+  for (int i = 0; i < 1000000; ++i) {
+    snek_object_t* next = new_snek_array(2);
+    snek_array_set(next, 0, head);
+    refcount_dec(head);
+    head = next;
+  }
+
+  refcount_dec(head);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_wide_array_spills(const MunitParameter params[],
+                                          void* data) {
+  // More children die at once than the inline queue holds
+  snek_object_t* array = new_snek_array(FREE_QUEUE_INLINE * 4);
+  for (size_t i = 0; i < FREE_QUEUE_INLINE * 4; ++i) {
+    snek_object_t* value = new_snek_string("spill");
+    snek_array_set(array, i, value);
+    refcount_dec(value);
+  }
+
+  refcount_dec(array);
+  munit_assert_true(boot_is_freed(array));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/array_set", test_array_set, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/array_free", test_array_free, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/has_refcount", test_int_has_refcount, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/inc_refcount", test_inc_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/dec_refcount", test_dec_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/free_refcount", test_refcount_free_is_called, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/string_freed", test_allocated_string_is_freed, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/vector3", test_vector3_refcounting, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/deep_vector_chain", test_deep_vector_chain, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/deep_array_chain", test_deep_array_chain, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/wide_array_spills", test_wide_array_spills, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {"/refcount", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE};
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
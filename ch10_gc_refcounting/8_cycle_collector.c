@@ -0,0 +1,939 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+#include "assert.h"
+
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+// Colors of the synchronous cycle collector (Bacon & Rajan, 2001)
+typedef enum SnekColor {
+  BLACK,   // in use or free
+  GRAY,    // possible member of a cycle
+  WHITE,   // member of a garbage cycle
+  PURPLE,  // possible root of a cycle
+} snek_color_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  snek_color_t color;
+  bool buffered;  // sitting in the candidate roots
+} snek_object_t;
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+void refcount_collect_cycles();
+void refcount_safepoint();
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_obj->kind != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+  // Store before releasing, the old value may die and nothing freed along
+  // with it can be left reachable through this slot
+  snek_object_t* old = snek_obj->data.v_array.elements[index];
+  refcount_inc(value);
+  snek_obj->data.v_array.elements[index] = value;
+  refcount_dec(old);
+  return true;
+}
+
+typedef struct ObjectStack {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+} object_stack_t;
+
+void object_stack_push(object_stack_t* stack, snek_object_t* obj) {
+  if (stack->count == stack->capacity) {
+    size_t capacity = stack->capacity ? stack->capacity * 2 : 8;
+    snek_object_t** data =
+        realloc(stack->data, capacity * sizeof(snek_object_t*));
+    if (data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+    stack->data = data;
+    stack->capacity = capacity;
+  }
+
+  stack->data[stack->count++] = obj;
+}
+
+snek_object_t* object_stack_pop(object_stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+  return stack->data[--stack->count];
+}
+
+void object_stack_clear(object_stack_t* stack) {
+  free(stack->data);
+  *stack = (object_stack_t){0};
+}
+
+// Decrements that leave a count above zero might have cut the last outside
+// reference into a cycle, those objects are buffered here and trial-deleted
+// by refcount_collect_cycles. A full buffer starts a collection at the next
+// refcount_safepoint, never from inside a decrement, whose caller may still
+// be halfway through updating a reference.
+#define CYCLE_ROOTS_MAX 1024
+
+static object_stack_t cycle_roots = {0};
+
+// Objects whose count hit zero wait here instead of being freed on the spot.
+// Freeing a child only queues it, so releasing a deep chain is a loop over
+// the queue rather than one C stack frame per level. The inline part covers
+// the usual short bursts, longer ones spill into a heap buffer that is
+// released as soon as the queue drains.
+#define FREE_QUEUE_INLINE 64
+
+typedef struct FreeQueue {
+  size_t count;
+  size_t capacity;
+  snek_object_t** data;
+  snek_object_t* inline_data[FREE_QUEUE_INLINE];
+  bool draining;
+} free_queue_t;
+
+static free_queue_t free_queue = {
+    .count = 0,
+    .capacity = FREE_QUEUE_INLINE,
+    .data = free_queue.inline_data,
+    .draining = false,
+};
+
+void free_queue_push(snek_object_t* obj) {
+  if (free_queue.count == free_queue.capacity) {
+    size_t capacity = free_queue.capacity * 2;
+    snek_object_t** data;
+    if (free_queue.data == free_queue.inline_data) {
+      data = malloc(capacity * sizeof(snek_object_t*));
+      if (data != NULL) {
+        memcpy(data, free_queue.inline_data,
+               free_queue.count * sizeof(snek_object_t*));
+      }
+    } else {
+      data = realloc(free_queue.data, capacity * sizeof(snek_object_t*));
+    }
+    if (data == NULL) {
+      // Unable to grow the queue, just exit :) get gud
+      exit(1);
+    }
+    free_queue.data = data;
+    free_queue.capacity = capacity;
+  }
+
+  free_queue.data[free_queue.count++] = obj;
+}
+
+void free_queue_drain() {
+  free_queue.draining = true;
+  // LIFO, so a dying object's children are freed right after it while they
+  // are still in cache
+  while (free_queue.count > 0) {
+    refcount_free(free_queue.data[--free_queue.count]);
+  }
+  free_queue.draining = false;
+
+  if (free_queue.data != free_queue.inline_data) {
+    free(free_queue.data);
+    free_queue.data = free_queue.inline_data;
+    free_queue.capacity = FREE_QUEUE_INLINE;
+  }
+}
+
+// Integers, floats and strings hold no references, they can never be part
+// of a cycle and are not worth buffering.
+bool snek_is_acyclic(snek_object_t* obj) {
+  return obj->kind == INTEGER || obj->kind == FLOAT || obj->kind == STRING;
+}
+
+size_t snek_child_count(snek_object_t* obj) {
+  switch (obj->kind) {
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    default:
+      return 0;
+  }
+}
+
+snek_object_t* snek_child(snek_object_t* obj, size_t index) {
+  switch (obj->kind) {
+    case VECTOR3:
+      return index == 0   ? obj->data.v_vector3.x
+             : index == 1 ? obj->data.v_vector3.y
+                          : obj->data.v_vector3.z;
+    case ARRAY:
+      return obj->data.v_array.elements[index];
+    default:
+      return NULL;
+  }
+}
+
+void refcount_possible_root(snek_object_t* obj) {
+  if (snek_is_acyclic(obj) || obj->color == PURPLE) {
+    return;
+  }
+
+  obj->color = PURPLE;
+  if (!obj->buffered) {
+    obj->buffered = true;
+    object_stack_push(&cycle_roots, obj);
+  }
+}
+
+void refcount_dec(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    obj->color = BLACK;
+    free_queue_push(obj);
+    // Only the outermost release drains, nested ones just add to the queue
+    if (!free_queue.draining) {
+      free_queue_drain();
+    }
+  } else {
+    refcount_possible_root(obj);
+  }
+  return;
+}
+
+// Called by the mutator when no reference update is in flight
+void refcount_safepoint() {
+  if (cycle_roots.count >= CYCLE_ROOTS_MAX) {
+    refcount_collect_cycles();
+  }
+}
+
+// Frees the object's own memory, its children are not touched
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case VECTOR3:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case ARRAY:
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  free(obj);
+}
+
+// Only called from free_queue_drain, the children's refcount_dec calls queue
+// them instead of recursing.
+void refcount_free(snek_object_t* obj) {
+  for (size_t i = 0; i < snek_child_count(obj); ++i) {
+    refcount_dec(snek_child(obj, i));
+  }
+
+  // The candidate roots still point at it, the collector frees it when it
+  // gets there
+  if (obj->buffered) {
+    return;
+  }
+  snek_object_free(obj);
+}
+
+// Trial deletion: subtract the references that come from inside the
+// subgraph reachable from the candidates. Whatever still has a count is
+// referenced from outside and gets its counts back, whatever drops to zero
+// is only kept alive by a cycle. All three passes walk an explicit stack,
+// like the free queue, so long chains don't eat the C stack.
+void cycle_mark_gray(object_stack_t* work, snek_object_t* root) {
+  object_stack_push(work, root);
+  while (work->count > 0) {
+    snek_object_t* obj = object_stack_pop(work);
+    if (obj->color == GRAY) {
+      continue;
+    }
+
+    obj->color = GRAY;
+    for (size_t i = 0; i < snek_child_count(obj); ++i) {
+      snek_object_t* child = snek_child(obj, i);
+      if (child == NULL) {
+        continue;
+      }
+      child->refcount--;
+      if (child->color != GRAY) {
+        object_stack_push(work, child);
+      }
+    }
+  }
+}
+
+void cycle_scan_black(object_stack_t* work, snek_object_t* root) {
+  root->color = BLACK;
+  object_stack_push(work, root);
+  while (work->count > 0) {
+    snek_object_t* obj = object_stack_pop(work);
+    for (size_t i = 0; i < snek_child_count(obj); ++i) {
+      snek_object_t* child = snek_child(obj, i);
+      if (child == NULL) {
+        continue;
+      }
+      child->refcount++;
+      if (child->color != BLACK) {
+        child->color = BLACK;
+        object_stack_push(work, child);
+      }
+    }
+  }
+}
+
+void cycle_scan(object_stack_t* work, snek_object_t* root) {
+  object_stack_t black = {0};
+
+  object_stack_push(work, root);
+  while (work->count > 0) {
+    snek_object_t* obj = object_stack_pop(work);
+    if (obj->color != GRAY) {
+      continue;
+    }
+
+    if (obj->refcount > 0) {
+      cycle_scan_black(&black, obj);
+      continue;
+    }
+
+    obj->color = WHITE;
+    for (size_t i = 0; i < snek_child_count(obj); ++i) {
+      snek_object_t* child = snek_child(obj, i);
+      if (child != NULL) {
+        object_stack_push(work, child);
+      }
+    }
+  }
+
+  object_stack_clear(&black);
+}
+
+// Gathers the white objects instead of freeing them on the way, a garbage
+// cycle reached again from a later candidate must still be readable.
+void cycle_collect_white(object_stack_t* work, object_stack_t* garbage,
+                         snek_object_t* root) {
+  if (root->color != WHITE || root->buffered) {
+    return;
+  }
+
+  root->color = BLACK;
+  object_stack_push(work, root);
+  while (work->count > 0) {
+    snek_object_t* obj = object_stack_pop(work);
+    for (size_t i = 0; i < snek_child_count(obj); ++i) {
+      snek_object_t* child = snek_child(obj, i);
+      if (child != NULL && child->color == WHITE && !child->buffered) {
+        child->color = BLACK;
+        object_stack_push(work, child);
+      }
+    }
+    object_stack_push(garbage, obj);
+  }
+}
+
+void refcount_collect_cycles() {
+  object_stack_t work = {0};
+
+  // Mark roots, dropping candidates that were released or touched again
+  size_t kept = 0;
+  for (size_t i = 0; i < cycle_roots.count; ++i) {
+    snek_object_t* obj = cycle_roots.data[i];
+    if (obj->color == PURPLE) {
+      cycle_roots.data[kept++] = obj;
+      cycle_mark_gray(&work, obj);
+      continue;
+    }
+
+    obj->buffered = false;
+    if (obj->color == BLACK && obj->refcount == 0) {
+      snek_object_free(obj);
+    }
+  }
+  cycle_roots.count = kept;
+
+  for (size_t i = 0; i < cycle_roots.count; ++i) {
+    cycle_scan(&work, cycle_roots.data[i]);
+  }
+
+  object_stack_t garbage = {0};
+  for (size_t i = 0; i < cycle_roots.count; ++i) {
+    snek_object_t* obj = cycle_roots.data[i];
+    obj->buffered = false;
+    cycle_collect_white(&work, &garbage, obj);
+  }
+
+  // Edges out of a garbage cycle were already taken off during
+  // cycle_mark_gray, so it is freed without decrementing anything
+  for (size_t i = 0; i < garbage.count; ++i) {
+    snek_object_free(garbage.data[i]);
+  }
+
+  object_stack_clear(&garbage);
+  object_stack_clear(&cycle_roots);
+  object_stack_clear(&work);
+}
+
+// don't touch below this line
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_obj->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  obj->refcount++;
+  // Referenced again, so no longer a candidate. The collector drops it from
+  // the roots when it sees the color.
+  obj->color = BLACK;
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+
+static MunitResult test_array_set(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* array = new_snek_array(1);
+
+  snek_array_set(array, 0, foo);
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(foo);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_free(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* array = new_snek_array(2);
+
+  snek_array_set(array, 0, foo);
+  snek_array_set(array, 1, bar);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 1);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  snek_array_set(array, 0, baz);
+  munit_assert_true(boot_is_freed(foo));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  refcount_dec(array);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_refcounting(const MunitParameter params[],
+                                            void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* vec = new_snek_vector3(foo, bar, baz);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 2);
+
+  refcount_dec(foo);
+  munit_assert_false(boot_is_freed(foo));
+
+  refcount_dec(vec);
+  munit_assert_true(boot_is_freed(foo));
+  munit_assert_false(boot_is_freed(bar));
+  munit_assert_false(boot_is_freed(baz));
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_int_has_refcount(const MunitParameter params[],
+                                         void* data) {
+  snek_object_t* obj = new_snek_integer(10);
+  munit_assert_int(obj->refcount, ==, 1);
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_inc_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_dec_refcount(const MunitParameter params[],
+                                     void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_false(boot_is_freed(obj));
+
+  free(obj);
+  return MUNIT_OK;
+}
+
+static MunitResult test_refcount_free_is_called(const MunitParameter params[],
+                                                void* data) {
+  snek_object_t* obj = new_snek_float(4.20);
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_allocated_string_is_freed(const MunitParameter params[],
+                                                  void* data) {
+  snek_object_t* obj = new_snek_string("Hello @wagslane!");
+
+  refcount_inc(obj);
+  munit_assert_int(obj->refcount, ==, 2);
+
+  refcount_dec(obj);
+  munit_assert_int(obj->refcount, ==, 1);
+  munit_assert_string_equal(obj->data.v_string, "Hello @wagslane!");
+
+  refcount_dec(obj);
+  munit_assert_true(boot_is_freed(obj));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_wide_array_spills(const MunitParameter params[],
+                                          void* data) {
+  // More children die at once than the inline queue holds
+  snek_object_t* array = new_snek_array(FREE_QUEUE_INLINE * 4);
+  for (size_t i = 0; i < FREE_QUEUE_INLINE * 4; ++i) {
+    snek_object_t* value = new_snek_string("spill");
+    snek_array_set(array, i, value);
+    refcount_dec(value);
+  }
+
+  refcount_dec(array);
+  munit_assert_true(boot_is_freed(array));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_cycle_collected(const MunitParameter params[],
+                                        void* data) {
+  snek_object_t* first = new_snek_array(1);
+  snek_object_t* second = new_snek_array(1);
+
+  snek_array_set(first, 0, second);
+  snek_array_set(second, 0, first);
+
+  refcount_dec(first);
+  refcount_dec(second);
+
+  // Plain refcounting can't get rid of them
+  munit_assert_int(first->refcount, ==, 1);
+  munit_assert_int(second->refcount, ==, 1);
+  munit_assert_false(boot_is_freed(first));
+
+  refcount_collect_cycles();
+  munit_assert_true(boot_is_freed(first));
+  munit_assert_true(boot_is_freed(second));
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_self_cycle(const MunitParameter params[], void* data) {
+  snek_object_t* array = new_snek_array(1);
+  snek_array_set(array, 0, array);
+  refcount_dec(array);
+
+  refcount_collect_cycles();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_referenced_cycle_survives(const MunitParameter params[],
+                                                  void* data) {
+  snek_object_t* first = new_snek_array(1);
+  snek_object_t* second = new_snek_array(1);
+  snek_array_set(first, 0, second);
+  snek_array_set(second, 0, first);
+
+  // Still held from outside through first
+  refcount_dec(second);
+
+  refcount_collect_cycles();
+  munit_assert_false(boot_is_freed(first));
+  munit_assert_false(boot_is_freed(second));
+  munit_assert_int(first->refcount, ==, 2);
+  munit_assert_int(second->refcount, ==, 1);
+
+  refcount_dec(first);
+  refcount_collect_cycles();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_cycle_releases_children(const MunitParameter params[],
+                                                void* data) {
+  snek_object_t* live = new_snek_array(1);
+  snek_object_t* first = new_snek_array(2);
+  snek_object_t* second = new_snek_array(1);
+  snek_object_t* name = new_snek_string("only the cycle has me");
+
+  snek_array_set(first, 0, second);
+  snek_array_set(second, 0, first);
+  snek_array_set(first, 1, live);
+  snek_array_set(live, 0, name);
+  refcount_dec(name);
+  refcount_dec(first);
+  refcount_dec(second);
+  munit_assert_int(live->refcount, ==, 2);
+
+  refcount_collect_cycles();
+  munit_assert_true(boot_is_freed(first));
+  munit_assert_true(boot_is_freed(second));
+  munit_assert_false(boot_is_freed(live));
+  munit_assert_false(boot_is_freed(name));
+  munit_assert_int(live->refcount, ==, 1);
+  munit_assert_int(name->refcount, ==, 1);
+
+  refcount_dec(live);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_acyclic_not_buffered(const MunitParameter params[],
+                                             void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* vec = new_snek_vector3(foo, foo, foo);
+
+  refcount_dec(foo);
+  munit_assert_size(cycle_roots.count, ==, 0);
+
+  refcount_inc(vec);
+  refcount_dec(vec);
+  munit_assert_size(cycle_roots.count, ==, 1);
+
+  // Released while buffered, the collector frees it
+  refcount_dec(vec);
+  munit_assert_false(boot_is_freed(vec));
+  munit_assert_true(boot_is_freed(foo));
+
+  refcount_collect_cycles();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_full_buffer_collects(const MunitParameter params[],
+                                             void* data) {
+  snek_object_t* last = NULL;
+  for (int i = 0; i < CYCLE_ROOTS_MAX; ++i) {
+    last = new_snek_array(1);
+    snek_array_set(last, 0, last);
+    refcount_dec(last);
+    refcount_safepoint();
+  }
+
+  // Nobody asked for a collection, the full buffer started one
+  munit_assert_true(boot_is_freed(last));
+  munit_assert_size(cycle_roots.count, ==, 0);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_full_buffer_in_array_set(const MunitParameter params[],
+                                                 void* data) {
+  // Each element points back at holder, so trial deletion from any of them
+  // walks through holder's slot
+  snek_object_t* elements[CYCLE_ROOTS_MAX];
+  snek_object_t* holder = new_snek_array(1);
+  snek_object_t* child = new_snek_array(CYCLE_ROOTS_MAX);
+  for (size_t i = 0; i < CYCLE_ROOTS_MAX; ++i) {
+    elements[i] = new_snek_array(1);
+    snek_array_set(elements[i], 0, holder);
+    snek_array_set(child, i, elements[i]);
+  }
+  snek_array_set(holder, 0, child);
+  refcount_dec(child);
+
+  // child dies here and buffering its elements fills the roots
+  snek_object_t* value = new_snek_integer(1);
+  snek_array_set(holder, 0, value);
+  refcount_dec(value);
+  munit_assert_size(cycle_roots.count, >=, CYCLE_ROOTS_MAX);
+  munit_assert_ptr_equal(snek_array_get(holder, 0), value);
+
+  // child was buffered itself, the collector is the one that frees it
+  refcount_safepoint();
+  munit_assert_size(cycle_roots.count, ==, 0);
+  munit_assert_true(boot_is_freed(child));
+  munit_assert_false(boot_is_freed(holder));
+  munit_assert_int(holder->refcount, ==, 1 + CYCLE_ROOTS_MAX);
+
+  for (size_t i = 0; i < CYCLE_ROOTS_MAX; ++i) {
+    refcount_dec(elements[i]);
+  }
+  refcount_dec(holder);
+  refcount_collect_cycles();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_inc_clears_candidate(const MunitParameter params[],
+                                             void* data) {
+  snek_object_t* array = new_snek_array(1);
+  refcount_inc(array);
+  refcount_dec(array);
+  munit_assert_int(array->color, ==, PURPLE);
+
+  refcount_inc(array);
+  munit_assert_int(array->color, ==, BLACK);
+
+  // Dropped from the roots without being trial-deleted
+  refcount_collect_cycles();
+  munit_assert_size(cycle_roots.count, ==, 0);
+  munit_assert_int(array->refcount, ==, 2);
+
+  refcount_dec(array);
+  refcount_dec(array);
+  refcount_collect_cycles();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/array_set", test_array_set, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/array_free", test_array_free, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/has_refcount", test_int_has_refcount, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/inc_refcount", test_inc_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/dec_refcount", test_dec_refcount, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/free_refcount", test_refcount_free_is_called, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/string_freed", test_allocated_string_is_freed, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/vector3", test_vector3_refcounting, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/wide_array_spills", test_wide_array_spills, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/cycle_collected", test_cycle_collected, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/self_cycle", test_self_cycle, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/referenced_cycle_survives", test_referenced_cycle_survives, NULL,
+       NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/cycle_releases_children", test_cycle_releases_children, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/acyclic_not_buffered", test_acyclic_not_buffered, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/full_buffer_collects", test_full_buffer_collects, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/full_buffer_in_array_set", test_full_buffer_in_array_set, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/inc_clears_candidate", test_inc_clears_candidate, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {"/refcount", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE};
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
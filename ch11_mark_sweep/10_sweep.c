@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "../munit/munit.h"
+#include "../bootlib.h"
 //-----------------------------------------------------------------------------
 //----------------------------------Snek---------------------------------------
 typedef struct SnekObject snek_object_t;
@@ -445,14 +446,14 @@ static MunitResult test_simple(const MunitParameter params[], void* data) {
 
   vm_collect_garbage(vm);
   // nothing should be collected because we haven't freed the frame
-  // munit_assert_false(boot_is_freed(s));
+  munit_assert_false(boot_is_freed(s));
 
   frame_free(vm_frame_pop(vm));
   vm_collect_garbage(vm);
-  // munit_assert_true(boot_is_freed(s));
+  munit_assert_true(boot_is_freed(s));
 
   vm_free(vm);
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -486,26 +487,51 @@ static MunitResult test_full(const MunitParameter params[], void* data) {
   frame_free(vm_frame_pop(vm));
   vm_collect_garbage(vm);
 
-  // munit_assert_true(boot_is_freed(s3));
-  // munit_assert_false(boot_is_freed(s1));
-  // munit_assert_false(boot_is_freed(s2));
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_false(boot_is_freed(s1));
+  munit_assert_false(boot_is_freed(s2));
 
   frame_free(vm_frame_pop(vm));
   frame_free(vm_frame_pop(vm));
   vm_collect_garbage(vm);
 
-  // munit_assert_true(boot_is_freed(s1));
-  // munit_assert_true(boot_is_freed(s2));
-  // munit_assert_true(boot_is_freed(s3));
-  // munit_assert_true(boot_is_freed(v));
-  // munit_assert_true(boot_is_freed(i1));
-  // munit_assert_true(boot_is_freed(i2));
-  // munit_assert_true(boot_is_freed(i3));
+  munit_assert_true(boot_is_freed(s1));
+  munit_assert_true(boot_is_freed(s2));
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_true(boot_is_freed(v));
+  munit_assert_true(boot_is_freed(i1));
+  munit_assert_true(boot_is_freed(i2));
+  munit_assert_true(boot_is_freed(i3));
 
   munit_assert_int(vm->objects->count, ==, 0);
 
   vm_free(vm);
-  // munit_assert_true(boot_all_freed());
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_alloc_stats(const MunitParameter params[],
+                                    void* data) {
+  vm_t* vm = vm_new();
+  boot_stats_t before = boot_stats();
+
+  new_snek_string(vm, "snek");
+  new_snek_array(vm, 4);
+
+  boot_stats_t after = boot_stats();
+  munit_assert_int(after.alloc_count - before.alloc_count, ==, 4);
+  munit_assert_int(after.live_bytes - before.live_bytes, ==,
+                   2 * sizeof(snek_object_t) + 5 + 4 * sizeof(snek_object_t*));
+  munit_assert_int(after.peak_bytes, >=, after.live_bytes);
+  // "snek" plus its terminator lands in the (4, 8] byte class
+  munit_assert_int(after.size_classes[3] - before.size_classes[3], ==, 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(boot_alloc_size(), ==, before.live_bytes);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
 
   return MUNIT_OK;
 }
@@ -514,6 +540,8 @@ int main() {
   MunitTest tests[] = {
       {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
       {"/test_full", test_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_alloc_stats", test_alloc_stats, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
       {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
 
   MunitSuite suite = {
@@ -0,0 +1,703 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+// Bytes the object accounts for, header plus anything it owns
+size_t snek_object_size(snek_object_t* obj) {
+  switch (obj->kind) {
+    case STRING:
+      return sizeof(snek_object_t) + strlen(obj->data.v_string) + 1;
+    case ARRAY:
+      return sizeof(snek_object_t) +
+             obj->data.v_array.size * sizeof(snek_object_t*);
+    default:
+      return sizeof(snek_object_t);
+  }
+}
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// Collections start on their own once the bytes allocated since the last
+// one reach gc_growth_percent of the heap that survived it, GOGC style,
+// but never below gc_min_bytes. Allocation only counts the bytes, the check
+// runs at safepoints: popping a frame, or an explicit vm_safepoint.
+#define GC_GROWTH_PERCENT 100
+#define GC_MIN_BYTES (64 * 1024)
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  size_t bytes_since_gc;
+  size_t live_bytes;     // what survived the last collection
+  size_t gc_threshold;   // bytes_since_gc that triggers the next one
+  int gc_growth_percent;  // negative turns automatic collection off
+  size_t gc_min_bytes;
+  size_t collections;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->bytes_since_gc = 0;
+  vm->live_bytes = 0;
+  vm->gc_threshold = GC_MIN_BYTES;
+  vm->gc_growth_percent = GC_GROWTH_PERCENT;
+  vm->gc_min_bytes = GC_MIN_BYTES;
+  vm->collections = 0;
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+void vm_safepoint(vm_t* vm);
+
+// The popped frame's references are no longer roots, a good time to collect
+frame_t* vm_frame_pop(vm_t* vm) {
+  frame_t* frame = stack_pop(vm->frames);
+  vm_safepoint(vm);
+  return frame;
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  vm->live_bytes = 0;
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+      vm->live_bytes += snek_object_size(obj);
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+
+  // Let the heap grow in proportion to what is actually live
+  vm->gc_threshold = vm->live_bytes * (size_t)vm->gc_growth_percent / 100;
+  if (vm->gc_growth_percent < 0 || vm->gc_threshold < vm->gc_min_bytes) {
+    vm->gc_threshold = vm->gc_min_bytes;
+  }
+  vm->bytes_since_gc = 0;
+  vm->collections++;
+}
+
+void vm_account_allocation(vm_t* vm, size_t bytes) {
+  vm->bytes_since_gc += bytes;
+}
+
+// Collects if the threshold was crossed. Everything the mutator still needs
+// must be reachable from a frame here. Allocation never collects, so objects
+// held only in C locals, like arguments being passed to a constructor, are
+// safe between safepoints.
+void vm_safepoint(vm_t* vm) {
+  if (vm->gc_growth_percent < 0) {
+    return;
+  }
+  if (vm->bytes_since_gc >= vm->gc_threshold) {
+    vm_collect_garbage(vm);
+  }
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  vm_account_allocation(vm, sizeof(snek_object_t));
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+  vm_account_allocation(vm, size * sizeof(snek_object_t*));
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  vm_account_allocation(vm, len + 1);
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_simple(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "I wish I knew how to read.");
+  frame_reference_object(f1, s);
+
+  vm_collect_garbage(vm);
+  // nothing should be collected because we haven't freed the frame
+  munit_assert_false(boot_is_freed(s));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(s));
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_allocation_triggers(const MunitParameter params[],
+                                            void* data) {
+  vm_t* vm = vm_new();
+  vm->gc_min_bytes = 1024;
+  vm->gc_threshold = 1024;
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* kept = new_snek_string(vm, "still in a frame");
+  frame_reference_object(f1, kept);
+
+  // Nobody calls vm_collect_garbage, the garbage has to go by itself
+  for (int i = 0; i < 1000; ++i) {
+    new_snek_integer(vm, i);
+    vm_safepoint(vm);
+  }
+
+  munit_assert_size(vm->collections, >, 0);
+  munit_assert_size(vm->objects->count, <, 1000);
+  munit_assert_false(boot_is_freed(kept));
+  munit_assert_string_equal(kept->data.v_string, "still in a frame");
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_buffers_count(const MunitParameter params[],
+                                      void* data) {
+  vm_t* vm = vm_new();
+  vm->gc_min_bytes = 1024;
+  vm->gc_threshold = 1024;
+
+  // One object, but its elements alone are over the threshold
+  new_snek_array(vm, 256);
+  munit_assert_size(vm->bytes_since_gc, >=, 256 * sizeof(snek_object_t*));
+  munit_assert_size(vm->collections, ==, 0);
+
+  vm_safepoint(vm);
+  munit_assert_size(vm->collections, ==, 1);
+  munit_assert_size(vm->objects->count, ==, 0);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_constructor_arguments(const MunitParameter params[],
+                                             void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  // The threshold is crossed while the arguments are only C temporaries
+  vm->bytes_since_gc = vm->gc_threshold;
+  snek_object_t* v = new_snek_vector3(vm, new_snek_integer(vm, 1),
+                                      new_snek_integer(vm, 2),
+                                      new_snek_integer(vm, 3));
+  munit_assert_size(vm->collections, ==, 0);
+  frame_reference_object(f1, v);
+
+  vm_safepoint(vm);
+  munit_assert_size(vm->collections, ==, 1);
+  munit_assert_size(vm->objects->count, ==, 4);
+  munit_assert_false(boot_is_freed(v->data.v_vector3.x));
+  munit_assert_int(v->data.v_vector3.z->data.v_int, ==, 3);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_frame_pop_triggers(const MunitParameter params[],
+                                           void* data) {
+  vm_t* vm = vm_new();
+  vm->gc_min_bytes = 1024;
+  vm->gc_threshold = 1024;
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* big = new_snek_array(vm, 256);
+  frame_reference_object(f1, big);
+  munit_assert_size(vm->collections, ==, 0);
+
+  frame_free(vm_frame_pop(vm));
+  munit_assert_size(vm->collections, ==, 1);
+  munit_assert_true(boot_is_freed(big));
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_threshold_adapts(const MunitParameter params[],
+                                         void* data) {
+  vm_t* vm = vm_new();
+  vm->gc_min_bytes = 1024;
+  vm->gc_growth_percent = 50;
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* big = new_snek_array(vm, 1024);
+  frame_reference_object(f1, big);
+  vm_collect_garbage(vm);
+
+  munit_assert_size(vm->live_bytes, ==, snek_object_size(big));
+  munit_assert_size(vm->gc_threshold, ==, vm->live_bytes * 50 / 100);
+
+  // Once the big array dies the threshold falls back to the floor
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_size(vm->live_bytes, ==, 0);
+  munit_assert_size(vm->gc_threshold, ==, 1024);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_disabled(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  vm->gc_min_bytes = 64;
+  vm->gc_threshold = 64;
+  vm->gc_growth_percent = -1;
+
+  for (int i = 0; i < 100; ++i) {
+    new_snek_integer(vm, i);
+    vm_safepoint(vm);
+  }
+  munit_assert_size(vm->collections, ==, 0);
+  munit_assert_size(vm->objects->count, ==, 100);
+
+  // Collecting by hand still works
+  vm_collect_garbage(vm);
+  munit_assert_size(vm->objects->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_allocation_triggers", test_allocation_triggers, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_buffers_count", test_buffers_count, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_constructor_arguments", test_constructor_arguments, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_frame_pop_triggers", test_frame_pop_triggers, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_threshold_adapts", test_threshold_adapts, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_disabled", test_disabled, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "gc-trigger",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,748 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+// Integers and floats live in the pointer word itself. Heap objects are at
+// least 8 byte aligned, so a pointer with the low bit set can't be one of
+// them. The low three bits say which kind of immediate it is, the 32 bit
+// payload sits in the upper half. Every snek int and float fits, nothing
+// numeric is ever boxed on the heap.
+_Static_assert(sizeof(uintptr_t) == 8, "immediates need 64 bit pointers");
+
+#define SNEK_TAG_MASK 7
+#define SNEK_TAG_INT 1
+#define SNEK_TAG_FLOAT 3
+
+bool snek_is_immediate(snek_object_t* obj) {
+  return ((uintptr_t)obj & 1) != 0;
+}
+
+bool snek_is_int(snek_object_t* obj) {
+  return ((uintptr_t)obj & SNEK_TAG_MASK) == SNEK_TAG_INT;
+}
+
+bool snek_is_float(snek_object_t* obj) {
+  return ((uintptr_t)obj & SNEK_TAG_MASK) == SNEK_TAG_FLOAT;
+}
+
+snek_object_t* snek_box_int(int value) {
+  return (snek_object_t*)(((uintptr_t)(uint32_t)value << 32) | SNEK_TAG_INT);
+}
+
+int snek_unbox_int(snek_object_t* obj) {
+  return (int)(uint32_t)((uintptr_t)obj >> 32);
+}
+
+snek_object_t* snek_box_float(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return (snek_object_t*)(((uintptr_t)bits << 32) | SNEK_TAG_FLOAT);
+}
+
+float snek_unbox_float(snek_object_t* obj) {
+  uint32_t bits = (uint32_t)((uintptr_t)obj >> 32);
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// Use instead of obj->kind wherever obj might be an immediate
+snek_object_kind_t snek_kind(snek_object_t* obj) {
+  if (snek_is_int(obj)) {
+    return INTEGER;
+  }
+  if (snek_is_float(obj)) {
+    return FLOAT;
+  }
+  return obj->kind;
+}
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      if (snek_is_immediate(obj)) {
+        continue;
+      }
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  // Immediates own nothing, there is nothing to blacken
+  if (!gray_objects || !obj || snek_is_immediate(obj)) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || snek_is_immediate(obj) || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+// Neither allocates, the vm is only kept for the common constructor shape
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  return snek_box_int(value);
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  return snek_box_float(value);
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (snek_kind(array) != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (snek_kind(array) != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+int snek_length(snek_object_t* obj) {
+  if (obj == NULL) {
+    return -1;
+  }
+
+  switch (snek_kind(obj)) {
+    case INTEGER:
+    case FLOAT:
+      return 1;
+    case STRING:
+      return strlen(obj->data.v_string);
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    default:
+      return -1;
+  }
+}
+
+// Numbers never allocate, mixed int and float adds promote to float
+snek_object_t* snek_add(vm_t* vm, snek_object_t* a, snek_object_t* b) {
+  if (!a || !b) {
+    return NULL;
+  }
+
+  switch (snek_kind(a)) {
+    case INTEGER:
+      switch (snek_kind(b)) {
+        case INTEGER:
+          return snek_box_int(snek_unbox_int(a) + snek_unbox_int(b));
+        case FLOAT:
+          return snek_box_float(snek_unbox_int(a) + snek_unbox_float(b));
+        default:
+          return NULL;
+      }
+
+    case FLOAT:
+      switch (snek_kind(b)) {
+        case INTEGER:
+          return snek_box_float(snek_unbox_float(a) + snek_unbox_int(b));
+        case FLOAT:
+          return snek_box_float(snek_unbox_float(a) + snek_unbox_float(b));
+        default:
+          return NULL;
+      }
+
+    case STRING: {
+      if (snek_kind(b) != STRING) {
+        return NULL;
+      }
+
+      // +1 for null terminator
+      int new_len = strlen(a->data.v_string) + strlen(b->data.v_string) + 1;
+      char* tmp = calloc(sizeof(char), new_len);
+      if (tmp == NULL) {
+        return NULL;
+      }
+
+      strcat(tmp, a->data.v_string);
+      strcat(tmp, b->data.v_string);
+
+      snek_object_t* obj = new_snek_string(vm, tmp);
+      free(tmp);
+      return obj;
+    }
+
+    case VECTOR3:
+      if (snek_kind(b) != VECTOR3) {
+        return NULL;
+      }
+
+      return new_snek_vector3(
+          vm, snek_add(vm, a->data.v_vector3.x, b->data.v_vector3.x),
+          snek_add(vm, a->data.v_vector3.y, b->data.v_vector3.y),
+          snek_add(vm, a->data.v_vector3.z, b->data.v_vector3.z));
+
+    case ARRAY: {
+      if (snek_kind(b) != ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_array.size;
+      size_t b_len = b->data.v_array.size;
+      snek_object_t* arr = new_snek_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      for (size_t i = 0; i < a_len; ++i) {
+        snek_array_set(arr, i, snek_array_get(a, i));
+      }
+      for (size_t i = 0; i < b_len; ++i) {
+        snek_array_set(arr, a_len + i, snek_array_get(b, i));
+      }
+      return arr;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_box_unbox(const MunitParameter params[], void* data) {
+  int ints[] = {0, 1, -1, 42, 2147483647, -2147483647 - 1};
+  for (size_t i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i) {
+    snek_object_t* obj = snek_box_int(ints[i]);
+    munit_assert_true(snek_is_immediate(obj));
+    munit_assert_true(snek_is_int(obj));
+    munit_assert_false(snek_is_float(obj));
+    munit_assert_int(snek_unbox_int(obj), ==, ints[i]);
+  }
+
+  float floats[] = {0.0f, -0.0f, 1.5f, -3.25f, 1e30f};
+  for (size_t i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i) {
+    snek_object_t* obj = snek_box_float(floats[i]);
+    munit_assert_true(snek_is_float(obj));
+    munit_assert_false(snek_is_int(obj));
+    munit_assert_float(snek_unbox_float(obj), ==, floats[i]);
+  }
+
+  // A real object is never mistaken for an immediate
+  vm_t* vm = vm_new();
+  snek_object_t* s = new_snek_string(vm, "boxed");
+  munit_assert_false(snek_is_immediate(s));
+  munit_assert_int(snek_kind(s), ==, STRING);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_numbers_allocate_nothing(const MunitParameter params[],
+                                                 void* data) {
+  vm_t* vm = vm_new();
+  boot_stats_t before = boot_stats();
+
+  snek_object_t* sum = new_snek_integer(vm, 0);
+  for (int i = 0; i < 1000; ++i) {
+    sum = snek_add(vm, sum, new_snek_integer(vm, i));
+  }
+  snek_object_t* mixed = snek_add(vm, sum, new_snek_float(vm, 0.5));
+
+  munit_assert_int(snek_kind(sum), ==, INTEGER);
+  munit_assert_int(snek_unbox_int(sum), ==, 499500);
+  munit_assert_int(snek_kind(mixed), ==, FLOAT);
+  munit_assert_float(snek_unbox_float(mixed), ==, 499500.5f);
+  munit_assert_int(snek_length(sum), ==, 1);
+
+  munit_assert_size(boot_stats().alloc_count, ==, before.alloc_count);
+  munit_assert_int(vm->objects->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_add_objects(const MunitParameter params[],
+                                    void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* v1 = new_snek_vector3(vm, new_snek_float(vm, 1.0),
+                                       new_snek_integer(vm, 2),
+                                       new_snek_float(vm, 3.0));
+  snek_object_t* v2 = new_snek_vector3(vm, new_snek_float(vm, 4.0),
+                                       new_snek_integer(vm, 5),
+                                       new_snek_integer(vm, 6));
+  snek_object_t* v3 = snek_add(vm, v1, v2);
+  frame_reference_object(f1, v3);
+
+  // Only the three vectors are on the heap
+  munit_assert_int(vm->objects->count, ==, 3);
+  munit_assert_float(snek_unbox_float(v3->data.v_vector3.x), ==, 5.0f);
+  munit_assert_int(snek_unbox_int(v3->data.v_vector3.y), ==, 7);
+  munit_assert_float(snek_unbox_float(v3->data.v_vector3.z), ==, 9.0f);
+
+  snek_object_t* hello = new_snek_string(vm, "hello");
+  snek_object_t* world = new_snek_string(vm, ", world");
+  snek_object_t* greeting = snek_add(vm, hello, world);
+  frame_reference_object(f1, greeting);
+  munit_assert_string_equal(greeting->data.v_string, "hello, world");
+  munit_assert_int(snek_length(greeting), ==, 12);
+
+  snek_object_t* ones = new_snek_array(vm, 2);
+  snek_array_set(ones, 0, new_snek_integer(vm, 1));
+  snek_array_set(ones, 1, new_snek_integer(vm, 1));
+  snek_object_t* more = snek_add(vm, ones, ones);
+  frame_reference_object(f1, more);
+  munit_assert_int(snek_length(more), ==, 4);
+  munit_assert_int(snek_unbox_int(snek_array_get(more, 3)), ==, 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(v1));
+  munit_assert_true(boot_is_freed(hello));
+  munit_assert_true(boot_is_freed(ones));
+  munit_assert_false(boot_is_freed(v3));
+  munit_assert_false(boot_is_freed(greeting));
+  munit_assert_false(boot_is_freed(more));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_trace_skips_immediates(const MunitParameter params[],
+                                               void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Immediates in frames and in arrays next to real objects
+  snek_object_t* s = new_snek_string(vm, "in an array");
+  snek_object_t* array = new_snek_array(vm, 3);
+  snek_array_set(array, 0, new_snek_integer(vm, 1));
+  snek_array_set(array, 1, s);
+  snek_array_set(array, 2, new_snek_float(vm, 2.5));
+  frame_reference_object(f1, new_snek_integer(vm, 69));
+  frame_reference_object(f1, array);
+
+  vm_collect_garbage(vm);
+  munit_assert_false(boot_is_freed(s));
+  munit_assert_false(boot_is_freed(array));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(s));
+  munit_assert_true(boot_is_freed(array));
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_box_unbox", test_box_unbox, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_numbers_allocate_nothing", test_numbers_allocate_nothing, NULL,
+       NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_add_objects", test_add_objects, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_trace_skips_immediates", test_trace_skips_immediates, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "tagged-immediates",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
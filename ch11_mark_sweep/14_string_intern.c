@@ -0,0 +1,699 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+  bool is_interned;
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------Intern--------------------------------------
+// Interned strings are shared: new_snek_string hands back the object that
+// already holds the same bytes, so equal interned strings are the same
+// pointer. The table is weak, it doesn't keep strings alive. Sweep takes a
+// dead string out before freeing it. Open addressing with linear probing and
+// backward-shift deletion, like bootlib's allocation table.
+#define INTERN_INITIAL_CAPACITY 64
+
+typedef struct InternEntry {
+  uint64_t hash;
+  snek_object_t* string;
+} intern_entry_t;
+
+typedef struct InternTable {
+  size_t count;
+  size_t capacity;
+  intern_entry_t* entries;
+} intern_table_t;
+
+// FNV-1a
+uint64_t intern_hash(char* value) {
+  uint64_t hash = 14695981039346656037ull;
+  for (; *value; ++value) {
+    hash ^= (unsigned char)*value;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// Slot holding value, or the empty slot where it would go
+size_t intern_find(intern_table_t* table, char* value, uint64_t hash) {
+  size_t mask = table->capacity - 1;
+  size_t i = hash & mask;
+  while (table->entries[i].string != NULL) {
+    intern_entry_t* entry = &table->entries[i];
+    if (entry->hash == hash &&
+        strcmp(entry->string->data.v_string, value) == 0) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+snek_object_t* intern_lookup(intern_table_t* table, char* value) {
+  if (table->count == 0) {
+    return NULL;
+  }
+  return table->entries[intern_find(table, value, intern_hash(value))].string;
+}
+
+bool intern_grow(intern_table_t* table) {
+  size_t capacity =
+      table->capacity ? table->capacity * 2 : INTERN_INITIAL_CAPACITY;
+  intern_entry_t* entries = calloc(capacity, sizeof(intern_entry_t));
+  if (entries == NULL) {
+    return false;
+  }
+
+  intern_entry_t* old = table->entries;
+  size_t old_capacity = table->capacity;
+  table->entries = entries;
+  table->capacity = capacity;
+  for (size_t i = 0; i < old_capacity; ++i) {
+    if (old[i].string == NULL) {
+      continue;
+    }
+    size_t slot = old[i].hash & (capacity - 1);
+    while (entries[slot].string != NULL) {
+      slot = (slot + 1) & (capacity - 1);
+    }
+    entries[slot] = old[i];
+  }
+
+  free(old);
+  return true;
+}
+
+bool intern_insert(intern_table_t* table, snek_object_t* string) {
+  // Keep the load factor under 1/2 so probe sequences stay short
+  if ((table->count + 1) * 2 > table->capacity && !intern_grow(table)) {
+    return false;
+  }
+
+  uint64_t hash = intern_hash(string->data.v_string);
+  size_t i = intern_find(table, string->data.v_string, hash);
+  table->entries[i] = (intern_entry_t){.hash = hash, .string = string};
+  table->count++;
+  string->is_interned = true;
+  return true;
+}
+
+void intern_remove(intern_table_t* table, snek_object_t* string) {
+  size_t mask = table->capacity - 1;
+  char* value = string->data.v_string;
+  size_t hole = intern_find(table, value, intern_hash(value));
+  if (table->entries[hole].string != string) {
+    return;
+  }
+
+  // Shift the rest of the probe run back into the hole, so lookups never
+  // need tombstones
+  size_t i = hole;
+  while (true) {
+    i = (i + 1) & mask;
+    if (table->entries[i].string == NULL) {
+      break;
+    }
+
+    size_t home = table->entries[i].hash & mask;
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      table->entries[hole] = table->entries[i];
+      hole = i;
+    }
+  }
+
+  table->entries[hole].string = NULL;
+  table->count--;
+  string->is_interned = false;
+}
+
+void intern_free(intern_table_t* table) {
+  free(table->entries);
+  *table = (intern_table_t){0};
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  bool intern_strings;  // off by default
+  intern_table_t strings;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->intern_strings = false;
+  vm->strings = (intern_table_t){0};
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  intern_free(&vm->strings);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      if (obj->is_interned) {
+        intern_remove(&vm->strings, obj);
+      }
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  if (vm->intern_strings) {
+    snek_object_t* interned = intern_lookup(&vm->strings, value);
+    if (interned != NULL) {
+      return interned;
+    }
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  // Not being interned only costs the sharing, the string itself is fine
+  if (vm->intern_strings) {
+    intern_insert(&vm->strings, obj);
+  }
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_intern_shares(const MunitParameter params[],
+                                      void* data) {
+  vm_t* vm = vm_new();
+  vm->intern_strings = true;
+  frame_t* f1 = vm_new_frame(vm);
+
+  boot_stats_t before = boot_stats();
+  snek_object_t* a = new_snek_string(vm, "identifier");
+  size_t allocs = boot_stats().alloc_count - before.alloc_count;
+
+  // The repeats cost nothing and compare by pointer
+  before = boot_stats();
+  snek_object_t* b = new_snek_string(vm, "identifier");
+  munit_assert_ptr_equal(a, b);
+  munit_assert_size(boot_stats().alloc_count, ==, before.alloc_count);
+  munit_assert_size(allocs, >, 0);
+
+  snek_object_t* c = new_snek_string(vm, "identifiers");
+  munit_assert_ptr_not_equal(a, c);
+  munit_assert_size(vm->strings.count, ==, 2);
+
+  frame_reference_object(f1, a);
+  frame_reference_object(f1, c);
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_intern_off(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* a = new_snek_string(vm, "identifier");
+  snek_object_t* b = new_snek_string(vm, "identifier");
+  munit_assert_ptr_not_equal(a, b);
+  munit_assert_size(vm->strings.count, ==, 0);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_sweep_clears_entries(const MunitParameter params[],
+                                             void* data) {
+  vm_t* vm = vm_new();
+  vm->intern_strings = true;
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Enough to grow the table and to leave long probe runs behind
+  snek_object_t* kept[1000];
+  for (int i = 0; i < 1000; ++i) {
+    char name[16];
+    snprintf(name, sizeof(name), "name_%d", i);
+    kept[i] = new_snek_string(vm, name);
+    if (i % 2 == 0) {
+      frame_reference_object(f1, kept[i]);
+    }
+  }
+  munit_assert_size(vm->strings.count, ==, 1000);
+
+  vm_collect_garbage(vm);
+  munit_assert_size(vm->strings.count, ==, 500);
+
+  // Survivors are still found, the dead ones come back as new objects
+  for (int i = 0; i < 1000; ++i) {
+    char name[16];
+    snprintf(name, sizeof(name), "name_%d", i);
+    if (i % 2 == 0) {
+      munit_assert_ptr_equal(intern_lookup(&vm->strings, name), kept[i]);
+    } else {
+      munit_assert_null(intern_lookup(&vm->strings, name));
+    }
+  }
+  snek_object_t* again = new_snek_string(vm, "name_1");
+  munit_assert_string_equal(again->data.v_string, "name_1");
+  munit_assert_true(again->is_interned);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_size(vm->strings.count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_intern_shares", test_intern_shares, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_intern_off", test_intern_off, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_sweep_clears_entries", test_sweep_clears_entries, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "string-intern",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
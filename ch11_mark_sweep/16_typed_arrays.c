@@ -0,0 +1,1024 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+// Typed arrays keep their numbers unboxed in one contiguous buffer, no
+// element is an object of its own.
+typedef struct {
+  size_t size;
+  int* elements;
+} snek_int_array_t;
+
+typedef struct {
+  size_t size;
+  float* elements;
+} snek_float_array_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+  INT_ARRAY,
+  FLOAT_ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+  snek_int_array_t v_int_array;
+  snek_float_array_t v_float_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+    case INT_ARRAY:
+      free(obj->data.v_int_array.elements);
+      break;
+    case FLOAT_ARRAY:
+      free(obj->data.v_float_array.elements);
+      break;
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- SIMD--------------------------------------
+// Four lanes per iteration, the tail is finished one element at a time so the
+// buffers need no particular length or alignment. Without SSE2 only the
+// scalar loop runs. Int adds wrap like the vector instruction does.
+void simd_add_int(int* out, const int* a, const int* b, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b[i]);
+  }
+}
+
+void simd_add_float(float* out, const float* a, const float* b, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_add_ps(x, y));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+void simd_add_int_scalar(int* out, const int* a, int b, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128i y = _mm_set1_epi32(b);
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b);
+  }
+}
+
+void simd_add_float_scalar(float* out, const float* a, float b,
+                           size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  __m128 y = _mm_set1_ps(b);
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    _mm_storeu_ps(out + i, _mm_add_ps(x, y));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = a[i] + b;
+  }
+}
+
+void simd_int_to_float(float* out, const int* a, size_t count) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_ps(out + i, _mm_cvtepi32_ps(x));
+  }
+#endif
+  for (; i < count; ++i) {
+    out[i] = (float)a[i];
+  }
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+    // Raw numbers, nothing to trace however long the buffer is
+    case INT_ARRAY:
+    case FLOAT_ARRAY:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_int_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int* elements = calloc(size, sizeof(int));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = INT_ARRAY;
+  obj->data.v_int_array =
+      (snek_int_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_float_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  float* elements = calloc(size, sizeof(float));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = FLOAT_ARRAY;
+  obj->data.v_float_array =
+      (snek_float_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+int snek_length(snek_object_t* obj) {
+  if (obj == NULL) {
+    return -1;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      return 1;
+    case STRING:
+      return strlen(obj->data.v_string);
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    case INT_ARRAY:
+      return obj->data.v_int_array.size;
+    case FLOAT_ARRAY:
+      return obj->data.v_float_array.size;
+    default:
+      return -1;
+  }
+}
+
+// Adds a number to every element. An int array plus a float promotes to a
+// float array, the same way a mixed scalar add does.
+snek_object_t* snek_typed_array_add_scalar(vm_t* vm, snek_object_t* a,
+                                           snek_object_t* b) {
+  if (a->kind == INT_ARRAY && b->kind == INTEGER) {
+    size_t size = a->data.v_int_array.size;
+    snek_object_t* arr = new_snek_int_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    simd_add_int_scalar(arr->data.v_int_array.elements,
+                        a->data.v_int_array.elements, b->data.v_int, size);
+    return arr;
+  }
+
+  if (a->kind == INT_ARRAY && b->kind == FLOAT) {
+    size_t size = a->data.v_int_array.size;
+    snek_object_t* arr = new_snek_float_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    float* out = arr->data.v_float_array.elements;
+    simd_int_to_float(out, a->data.v_int_array.elements, size);
+    simd_add_float_scalar(out, out, b->data.v_float, size);
+    return arr;
+  }
+
+  if (a->kind == FLOAT_ARRAY && (b->kind == INTEGER || b->kind == FLOAT)) {
+    size_t size = a->data.v_float_array.size;
+    snek_object_t* arr = new_snek_float_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    float value = b->kind == INTEGER ? b->data.v_int : b->data.v_float;
+    simd_add_float_scalar(arr->data.v_float_array.elements,
+                          a->data.v_float_array.elements, value, size);
+    return arr;
+  }
+
+  return NULL;
+}
+
+// Element-wise sum of two typed arrays of the same kind and length. snek_add
+// on two arrays concatenates, like it does for ARRAY.
+snek_object_t* snek_add_elementwise(vm_t* vm, snek_object_t* a,
+                                    snek_object_t* b) {
+  if (!a || !b || a->kind != b->kind) {
+    return NULL;
+  }
+
+  switch (a->kind) {
+    case INT_ARRAY: {
+      size_t size = a->data.v_int_array.size;
+      if (b->data.v_int_array.size != size) {
+        return NULL;
+      }
+
+      snek_object_t* arr = new_snek_int_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      simd_add_int(arr->data.v_int_array.elements,
+                   a->data.v_int_array.elements, b->data.v_int_array.elements,
+                   size);
+      return arr;
+    }
+
+    case FLOAT_ARRAY: {
+      size_t size = a->data.v_float_array.size;
+      if (b->data.v_float_array.size != size) {
+        return NULL;
+      }
+
+      snek_object_t* arr = new_snek_float_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      simd_add_float(arr->data.v_float_array.elements,
+                     a->data.v_float_array.elements,
+                     b->data.v_float_array.elements, size);
+      return arr;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+snek_object_t* snek_add(vm_t* vm, snek_object_t* a, snek_object_t* b) {
+  if (!a || !b) {
+    return NULL;
+  }
+
+  switch (a->kind) {
+    case INTEGER:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_integer(vm, a->data.v_int + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(vm, a->data.v_int + b->data.v_float);
+        case INT_ARRAY:
+        case FLOAT_ARRAY:
+          return snek_typed_array_add_scalar(vm, b, a);
+        default:
+          return NULL;
+      }
+
+    case FLOAT:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_float(vm, a->data.v_float + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(vm, a->data.v_float + b->data.v_float);
+        case INT_ARRAY:
+        case FLOAT_ARRAY:
+          return snek_typed_array_add_scalar(vm, b, a);
+        default:
+          return NULL;
+      }
+
+    case STRING: {
+      if (b->kind != STRING) {
+        return NULL;
+      }
+
+      // +1 for null terminator
+      int new_len = strlen(a->data.v_string) + strlen(b->data.v_string) + 1;
+      char* tmp = calloc(sizeof(char), new_len);
+      if (tmp == NULL) {
+        return NULL;
+      }
+
+      strcat(tmp, a->data.v_string);
+      strcat(tmp, b->data.v_string);
+
+      snek_object_t* obj = new_snek_string(vm, tmp);
+      free(tmp);
+      return obj;
+    }
+
+    case VECTOR3:
+      if (b->kind != VECTOR3) {
+        return NULL;
+      }
+
+      return new_snek_vector3(
+          vm, snek_add(vm, a->data.v_vector3.x, b->data.v_vector3.x),
+          snek_add(vm, a->data.v_vector3.y, b->data.v_vector3.y),
+          snek_add(vm, a->data.v_vector3.z, b->data.v_vector3.z));
+
+    case ARRAY: {
+      if (b->kind != ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_array.size;
+      size_t b_len = b->data.v_array.size;
+      snek_object_t* arr = new_snek_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      for (size_t i = 0; i < a_len; ++i) {
+        snek_array_set(arr, i, snek_array_get(a, i));
+      }
+      for (size_t i = 0; i < b_len; ++i) {
+        snek_array_set(arr, a_len + i, snek_array_get(b, i));
+      }
+      return arr;
+    }
+
+    case INT_ARRAY: {
+      if (b->kind == INTEGER || b->kind == FLOAT) {
+        return snek_typed_array_add_scalar(vm, a, b);
+      }
+      if (b->kind != INT_ARRAY) {
+        return NULL;
+      }
+
+      // Two buffers copied back to back, no per-element work at all
+      size_t a_len = a->data.v_int_array.size;
+      size_t b_len = b->data.v_int_array.size;
+      snek_object_t* arr = new_snek_int_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      int* out = arr->data.v_int_array.elements;
+      memcpy(out, a->data.v_int_array.elements, a_len * sizeof(int));
+      memcpy(out + a_len, b->data.v_int_array.elements, b_len * sizeof(int));
+      return arr;
+    }
+
+    case FLOAT_ARRAY: {
+      if (b->kind == INTEGER || b->kind == FLOAT) {
+        return snek_typed_array_add_scalar(vm, a, b);
+      }
+      if (b->kind != FLOAT_ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_float_array.size;
+      size_t b_len = b->data.v_float_array.size;
+      snek_object_t* arr = new_snek_float_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      float* out = arr->data.v_float_array.elements;
+      memcpy(out, a->data.v_float_array.elements, a_len * sizeof(float));
+      memcpy(out + a_len, b->data.v_float_array.elements,
+             b_len * sizeof(float));
+      return arr;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_alloc_stats(const MunitParameter params[],
+                                    void* data) {
+  vm_t* vm = vm_new();
+  boot_stats_t before = boot_stats();
+
+  // A thousand ints are one object plus one buffer, not a thousand objects
+  new_snek_int_array(vm, 1000);
+
+  boot_stats_t after = boot_stats();
+  munit_assert_int(after.alloc_count - before.alloc_count, ==, 2);
+  munit_assert_int(after.live_bytes - before.live_bytes, ==,
+                   sizeof(snek_object_t) + 1000 * sizeof(int));
+  munit_assert_int(vm->objects->count, ==, 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(boot_alloc_size(), ==, before.live_bytes);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_trace_skips_elements(const MunitParameter params[],
+                                             void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* ints = new_snek_int_array(vm, 100000);
+  snek_object_t* floats = new_snek_float_array(vm, 100000);
+  frame_reference_object(f1, ints);
+  frame_reference_object(f1, floats);
+
+  // Blackening a typed array never grays anything
+  stack_t* gray_objects = stack_new(8);
+  trace_blacken_object(gray_objects, ints);
+  trace_blacken_object(gray_objects, floats);
+  munit_assert_int(gray_objects->count, ==, 0);
+  stack_free(gray_objects);
+
+  vm_collect_garbage(vm);
+  munit_assert_false(boot_is_freed(ints));
+  munit_assert_false(boot_is_freed(floats));
+  munit_assert_int(snek_length(ints), ==, 100000);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(ints));
+  munit_assert_true(boot_is_freed(floats));
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_add_elementwise(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new();
+
+  // 7 elements, so the scalar tail runs after one vector step
+  snek_object_t* a = new_snek_int_array(vm, 7);
+  snek_object_t* b = new_snek_int_array(vm, 7);
+  snek_object_t* fa = new_snek_float_array(vm, 7);
+  snek_object_t* fb = new_snek_float_array(vm, 7);
+  for (int i = 0; i < 7; ++i) {
+    a->data.v_int_array.elements[i] = i;
+    b->data.v_int_array.elements[i] = 10 * i;
+    fa->data.v_float_array.elements[i] = i + 0.5f;
+    fb->data.v_float_array.elements[i] = 0.25f;
+  }
+
+  snek_object_t* sum = snek_add_elementwise(vm, a, b);
+  munit_assert_int(sum->kind, ==, INT_ARRAY);
+  snek_object_t* fsum = snek_add_elementwise(vm, fa, fb);
+  munit_assert_int(fsum->kind, ==, FLOAT_ARRAY);
+  for (int i = 0; i < 7; ++i) {
+    munit_assert_int(sum->data.v_int_array.elements[i], ==, 11 * i);
+    munit_assert_float(fsum->data.v_float_array.elements[i], ==, i + 0.75f);
+  }
+
+  // Kinds and lengths have to match
+  munit_assert_null(snek_add_elementwise(vm, a, fa));
+  munit_assert_null(snek_add_elementwise(vm, a, new_snek_int_array(vm, 6)));
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_add_scalar(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* a = new_snek_int_array(vm, 5);
+  for (int i = 0; i < 5; ++i) {
+    a->data.v_int_array.elements[i] = i;
+  }
+
+  snek_object_t* plus_int = snek_add(vm, a, new_snek_integer(vm, 100));
+  munit_assert_int(plus_int->kind, ==, INT_ARRAY);
+  snek_object_t* int_plus = snek_add(vm, new_snek_integer(vm, 100), a);
+  munit_assert_int(int_plus->kind, ==, INT_ARRAY);
+  snek_object_t* plus_float = snek_add(vm, a, new_snek_float(vm, 0.5));
+  munit_assert_int(plus_float->kind, ==, FLOAT_ARRAY);
+  snek_object_t* twice = snek_add(vm, plus_float, new_snek_integer(vm, 1));
+  munit_assert_int(twice->kind, ==, FLOAT_ARRAY);
+
+  for (int i = 0; i < 5; ++i) {
+    munit_assert_int(plus_int->data.v_int_array.elements[i], ==, i + 100);
+    munit_assert_int(int_plus->data.v_int_array.elements[i], ==, i + 100);
+    munit_assert_float(plus_float->data.v_float_array.elements[i], ==,
+                       i + 0.5f);
+    munit_assert_float(twice->data.v_float_array.elements[i], ==, i + 1.5f);
+  }
+
+  // The source array is untouched
+  munit_assert_int(a->data.v_int_array.elements[4], ==, 4);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_add_concat(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* a = new_snek_int_array(vm, 3);
+  snek_object_t* b = new_snek_int_array(vm, 2);
+  for (int i = 0; i < 3; ++i) {
+    a->data.v_int_array.elements[i] = i + 1;
+  }
+  for (int i = 0; i < 2; ++i) {
+    b->data.v_int_array.elements[i] = -(i + 1);
+  }
+
+  boot_stats_t before = boot_stats();
+  snek_object_t* joined = snek_add(vm, a, b);
+  boot_stats_t after = boot_stats();
+
+  // One object and one buffer, however long the inputs are
+  munit_assert_int(after.alloc_count - before.alloc_count, ==, 2);
+  munit_assert_int(joined->kind, ==, INT_ARRAY);
+  munit_assert_int(snek_length(joined), ==, 5);
+
+  int expected[] = {1, 2, 3, -1, -2};
+  for (int i = 0; i < 5; ++i) {
+    munit_assert_int(joined->data.v_int_array.elements[i], ==, expected[i]);
+  }
+
+  snek_object_t* fa = new_snek_float_array(vm, 2);
+  fa->data.v_float_array.elements[1] = 2.5f;
+  snek_object_t* fjoined = snek_add(vm, fa, fa);
+  munit_assert_int(snek_length(fjoined), ==, 4);
+  munit_assert_float(fjoined->data.v_float_array.elements[3], ==, 2.5f);
+
+  // No implicit conversion between the two buffer types, or to ARRAY
+  munit_assert_null(snek_add(vm, a, fa));
+  munit_assert_null(snek_add(vm, a, new_snek_array(vm, 1)));
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_alloc_stats", test_alloc_stats, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_trace_skips_elements", test_trace_skips_elements, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_add_elementwise", test_add_elementwise, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_add_scalar", test_add_scalar, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_add_concat", test_add_concat, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "typed-arrays",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,1636 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+// Typed arrays keep their numbers unboxed in one contiguous buffer, no
+// element is an object of its own.
+typedef struct {
+  size_t size;
+  int* elements;
+} snek_int_array_t;
+
+typedef struct {
+  size_t size;
+  float* elements;
+} snek_float_array_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+  INT_ARRAY,
+  FLOAT_ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+  snek_int_array_t v_int_array;
+  snek_float_array_t v_float_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+    case INT_ARRAY:
+      free(obj->data.v_int_array.elements);
+      break;
+    case FLOAT_ARRAY:
+      free(obj->data.v_float_array.elements);
+      break;
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- SIMD--------------------------------------
+// One table of kernels per instruction set. simd_kernels() picks the widest
+// table the CPU supports the first time it is called, so one binary runs
+// everywhere and still uses AVX2 where it exists. Each vector kernel hands
+// its tail to the scalar one, buffers need no particular length or alignment.
+// Int kernels wrap on overflow, the same as the vector instructions.
+typedef enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+} simd_level_t;
+
+typedef struct SimdKernels {
+  simd_level_t level;
+  const char* name;
+  void (*add_int)(int* out, const int* a, const int* b, size_t count);
+  void (*sub_int)(int* out, const int* a, const int* b, size_t count);
+  void (*mul_int)(int* out, const int* a, const int* b, size_t count);
+  void (*add_int_scalar)(int* out, const int* a, int b, size_t count);
+  void (*add_float)(float* out, const float* a, const float* b, size_t count);
+  void (*sub_float)(float* out, const float* a, const float* b, size_t count);
+  void (*mul_float)(float* out, const float* a, const float* b, size_t count);
+  void (*add_float_scalar)(float* out, const float* a, float b, size_t count);
+  void (*scale_float)(float* out, const float* a, float factor, size_t count);
+  float (*dot_float)(const float* a, const float* b, size_t count);
+  void (*int_to_float)(float* out, const int* a, size_t count);
+} simd_kernels_t;
+
+static void scalar_add_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b[i]);
+  }
+}
+
+static void scalar_sub_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] - (unsigned)b[i]);
+  }
+}
+
+static void scalar_mul_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] * (unsigned)b[i]);
+  }
+}
+
+static void scalar_add_int_scalar(int* out, const int* a, int b,
+                                  size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b);
+  }
+}
+
+static void scalar_add_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+static void scalar_sub_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] - b[i];
+  }
+}
+
+static void scalar_mul_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+static void scalar_add_float_scalar(float* out, const float* a, float b,
+                                    size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] + b;
+  }
+}
+
+static void scalar_scale_float(float* out, const float* a, float factor,
+                               size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] * factor;
+  }
+}
+
+static float scalar_dot_float(const float* a, const float* b, size_t count) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static void scalar_int_to_float(float* out, const int* a, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (float)a[i];
+  }
+}
+
+static const simd_kernels_t simd_scalar_kernels = {
+    .level = SIMD_SCALAR,
+    .name = "scalar",
+    .add_int = scalar_add_int,
+    .sub_int = scalar_sub_int,
+    .mul_int = scalar_mul_int,
+    .add_int_scalar = scalar_add_int_scalar,
+    .add_float = scalar_add_float,
+    .sub_float = scalar_sub_float,
+    .mul_float = scalar_mul_float,
+    .add_float_scalar = scalar_add_float_scalar,
+    .scale_float = scalar_scale_float,
+    .dot_float = scalar_dot_float,
+    .int_to_float = scalar_int_to_float,
+};
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+// The target attributes let these compile without -msse2/-mavx2, only the
+// dispatcher decides whether they ever run.
+#define SIMD_SSE2_TARGET __attribute__((target("sse2")))
+#define SIMD_AVX2_TARGET __attribute__((target("avx2")))
+
+static SIMD_SSE2_TARGET void sse2_add_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+  scalar_add_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_sub_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi32(x, y));
+  }
+  scalar_sub_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_int_scalar(int* out, const int* a, int b,
+                                                 size_t count) {
+  size_t i = 0;
+  __m128i y = _mm_set1_epi32(b);
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+  scalar_add_int_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_add_ps(x, y));
+  }
+  scalar_add_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_sub_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_sub_ps(x, y));
+  }
+  scalar_sub_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_mul_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_mul_ps(x, y));
+  }
+  scalar_mul_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_float_scalar(float* out, const float* a,
+                                                   float b, size_t count) {
+  size_t i = 0;
+  __m128 y = _mm_set1_ps(b);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), y));
+  }
+  scalar_add_float_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_scale_float(float* out, const float* a,
+                                              float factor, size_t count) {
+  size_t i = 0;
+  __m128 y = _mm_set1_ps(factor);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), y));
+  }
+  scalar_scale_float(out + i, a + i, factor, count - i);
+}
+
+static SIMD_SSE2_TARGET float sse2_dot_float(const float* a, const float* b,
+                                             size_t count) {
+  size_t i = 0;
+  __m128 sum = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         scalar_dot_float(a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_int_to_float(float* out, const int* a,
+                                               size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_ps(out + i, _mm_cvtepi32_ps(x));
+  }
+  scalar_int_to_float(out + i, a + i, count - i);
+}
+
+// SSE2 has no 32-bit multiply that keeps the low halves (that is SSE4.1), so
+// mul_int stays scalar at this level.
+static const simd_kernels_t simd_sse2_kernels = {
+    .level = SIMD_SSE2,
+    .name = "sse2",
+    .add_int = sse2_add_int,
+    .sub_int = sse2_sub_int,
+    .mul_int = scalar_mul_int,
+    .add_int_scalar = sse2_add_int_scalar,
+    .add_float = sse2_add_float,
+    .sub_float = sse2_sub_float,
+    .mul_float = sse2_mul_float,
+    .add_float_scalar = sse2_add_float_scalar,
+    .scale_float = sse2_scale_float,
+    .dot_float = sse2_dot_float,
+    .int_to_float = sse2_int_to_float,
+};
+
+static SIMD_AVX2_TARGET void avx2_add_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(x, y));
+  }
+  scalar_add_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_sub_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_sub_epi32(x, y));
+  }
+  scalar_sub_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_mul_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(x, y));
+  }
+  scalar_mul_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_int_scalar(int* out, const int* a, int b,
+                                                 size_t count) {
+  size_t i = 0;
+  __m256i y = _mm256_set1_epi32(b);
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(x, y));
+  }
+  scalar_add_int_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(x, y));
+  }
+  scalar_add_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_sub_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_sub_ps(x, y));
+  }
+  scalar_sub_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_mul_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(x, y));
+  }
+  scalar_mul_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_float_scalar(float* out, const float* a,
+                                                   float b, size_t count) {
+  size_t i = 0;
+  __m256 y = _mm256_set1_ps(b);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), y));
+  }
+  scalar_add_float_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_scale_float(float* out, const float* a,
+                                              float factor, size_t count) {
+  size_t i = 0;
+  __m256 y = _mm256_set1_ps(factor);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), y));
+  }
+  scalar_scale_float(out + i, a + i, factor, count - i);
+}
+
+static SIMD_AVX2_TARGET float avx2_dot_float(const float* a, const float* b,
+                                             size_t count) {
+  // Two accumulators, so each add doesn't wait on the one before it
+  size_t i = 0;
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  for (; i + 16 <= count; i += 16) {
+    __m256 x0 = _mm256_loadu_ps(a + i);
+    __m256 x1 = _mm256_loadu_ps(a + i + 8);
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(x0, _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(x1, _mm256_loadu_ps(b + i + 8)));
+  }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_add_ps(sum0, sum1));
+  float sum = 0.0f;
+  for (int lane = 0; lane < 8; ++lane) {
+    sum += lanes[lane];
+  }
+  return sum + scalar_dot_float(a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_int_to_float(float* out, const int* a,
+                                               size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(x));
+  }
+  scalar_int_to_float(out + i, a + i, count - i);
+}
+
+static const simd_kernels_t simd_avx2_kernels = {
+    .level = SIMD_AVX2,
+    .name = "avx2",
+    .add_int = avx2_add_int,
+    .sub_int = avx2_sub_int,
+    .mul_int = avx2_mul_int,
+    .add_int_scalar = avx2_add_int_scalar,
+    .add_float = avx2_add_float,
+    .sub_float = avx2_sub_float,
+    .mul_float = avx2_mul_float,
+    .add_float_scalar = avx2_add_float_scalar,
+    .scale_float = avx2_scale_float,
+    .dot_float = avx2_dot_float,
+    .int_to_float = avx2_int_to_float,
+};
+#endif
+
+static const simd_kernels_t* simd_active = NULL;
+
+// Returns the table for a level, or NULL when this CPU can't run it
+const simd_kernels_t* simd_kernels_for(simd_level_t level) {
+  switch (level) {
+    case SIMD_SCALAR:
+      return &simd_scalar_kernels;
+#if defined(SIMD_X86)
+    case SIMD_SSE2:
+      return __builtin_cpu_supports("sse2") ? &simd_sse2_kernels : NULL;
+    case SIMD_AVX2:
+      return __builtin_cpu_supports("avx2") ? &simd_avx2_kernels : NULL;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+const simd_kernels_t* simd_kernels() {
+  if (simd_active == NULL) {
+    for (int level = SIMD_AVX2; level >= SIMD_SCALAR; --level) {
+      simd_active = simd_kernels_for(level);
+      if (simd_active != NULL) {
+        break;
+      }
+    }
+  }
+  return simd_active;
+}
+
+// Pins every snek operation to one level, for tests and benchmarks
+bool simd_use(simd_level_t level) {
+  const simd_kernels_t* kernels = simd_kernels_for(level);
+  if (kernels == NULL) {
+    return false;
+  }
+
+  simd_active = kernels;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+    // Raw numbers, nothing to trace however long the buffer is
+    case INT_ARRAY:
+    case FLOAT_ARRAY:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_int_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int* elements = calloc(size, sizeof(int));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = INT_ARRAY;
+  obj->data.v_int_array =
+      (snek_int_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_float_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  float* elements = calloc(size, sizeof(float));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = FLOAT_ARRAY;
+  obj->data.v_float_array =
+      (snek_float_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+int snek_length(snek_object_t* obj) {
+  if (obj == NULL) {
+    return -1;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      return 1;
+    case STRING:
+      return strlen(obj->data.v_string);
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    case INT_ARRAY:
+      return obj->data.v_int_array.size;
+    case FLOAT_ARRAY:
+      return obj->data.v_float_array.size;
+    default:
+      return -1;
+  }
+}
+
+// Adds a number to every element. An int array plus a float promotes to a
+// float array, the same way a mixed scalar add does.
+snek_object_t* snek_typed_array_add_scalar(vm_t* vm, snek_object_t* a,
+                                           snek_object_t* b) {
+  const simd_kernels_t* simd = simd_kernels();
+
+  if (a->kind == INT_ARRAY && b->kind == INTEGER) {
+    size_t size = a->data.v_int_array.size;
+    snek_object_t* arr = new_snek_int_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    simd->add_int_scalar(arr->data.v_int_array.elements,
+                         a->data.v_int_array.elements, b->data.v_int, size);
+    return arr;
+  }
+
+  if (a->kind == INT_ARRAY && b->kind == FLOAT) {
+    size_t size = a->data.v_int_array.size;
+    snek_object_t* arr = new_snek_float_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    float* out = arr->data.v_float_array.elements;
+    simd->int_to_float(out, a->data.v_int_array.elements, size);
+    simd->add_float_scalar(out, out, b->data.v_float, size);
+    return arr;
+  }
+
+  if (a->kind == FLOAT_ARRAY && (b->kind == INTEGER || b->kind == FLOAT)) {
+    size_t size = a->data.v_float_array.size;
+    snek_object_t* arr = new_snek_float_array(vm, size);
+    if (arr == NULL) {
+      return NULL;
+    }
+
+    float value = b->kind == INTEGER ? b->data.v_int : b->data.v_float;
+    simd->add_float_scalar(arr->data.v_float_array.elements,
+                           a->data.v_float_array.elements, value, size);
+    return arr;
+  }
+
+  return NULL;
+}
+
+// Copies the three components into float lanes, false unless all of them are
+// numbers. Ints are promoted like in a mixed add.
+bool snek_vector3_load(snek_object_t* obj, float lanes[3]) {
+  if (obj == NULL || obj->kind != VECTOR3) {
+    return false;
+  }
+
+  snek_object_t* components[3] = {obj->data.v_vector3.x, obj->data.v_vector3.y,
+                                  obj->data.v_vector3.z};
+  for (int i = 0; i < 3; ++i) {
+    switch (components[i]->kind) {
+      case INTEGER:
+        lanes[i] = components[i]->data.v_int;
+        break;
+      case FLOAT:
+        lanes[i] = components[i]->data.v_float;
+        break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+bool snek_vector3_is_float(snek_object_t* obj) {
+  return obj != NULL && obj->kind == VECTOR3 &&
+         obj->data.v_vector3.x->kind == FLOAT &&
+         obj->data.v_vector3.y->kind == FLOAT &&
+         obj->data.v_vector3.z->kind == FLOAT;
+}
+
+snek_object_t* new_snek_vector3_from_lanes(vm_t* vm, float lanes[3]) {
+  return new_snek_vector3(vm, new_snek_float(vm, lanes[0]),
+                          new_snek_float(vm, lanes[1]),
+                          new_snek_float(vm, lanes[2]));
+}
+
+typedef enum SnekArithOp {
+  SNEK_ADD,
+  SNEK_SUB,
+  SNEK_MUL,
+} snek_arith_op_t;
+
+// Element-wise op on two typed arrays of the same kind and length, or on two
+// VECTOR3s of floats. snek_add on two arrays concatenates, like it does for
+// ARRAY.
+snek_object_t* snek_elementwise(vm_t* vm, snek_arith_op_t op, snek_object_t* a,
+                                snek_object_t* b) {
+  if (!a || !b || a->kind != b->kind) {
+    return NULL;
+  }
+
+  const simd_kernels_t* simd = simd_kernels();
+  switch (a->kind) {
+    case INT_ARRAY: {
+      size_t size = a->data.v_int_array.size;
+      if (b->data.v_int_array.size != size) {
+        return NULL;
+      }
+
+      snek_object_t* arr = new_snek_int_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      void (*kernel)(int*, const int*, const int*, size_t) =
+          op == SNEK_ADD   ? simd->add_int
+          : op == SNEK_SUB ? simd->sub_int
+                           : simd->mul_int;
+      kernel(arr->data.v_int_array.elements, a->data.v_int_array.elements,
+             b->data.v_int_array.elements, size);
+      return arr;
+    }
+
+    case FLOAT_ARRAY: {
+      size_t size = a->data.v_float_array.size;
+      if (b->data.v_float_array.size != size) {
+        return NULL;
+      }
+
+      snek_object_t* arr = new_snek_float_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      void (*kernel)(float*, const float*, const float*, size_t) =
+          op == SNEK_ADD   ? simd->add_float
+          : op == SNEK_SUB ? simd->sub_float
+                           : simd->mul_float;
+      kernel(arr->data.v_float_array.elements, a->data.v_float_array.elements,
+             b->data.v_float_array.elements, size);
+      return arr;
+    }
+
+    case VECTOR3: {
+      // Three lanes are all tail for the kernels, the win here is skipping
+      // three recursive snek_add dispatches.
+      float x[3], y[3], out[3];
+      if (!snek_vector3_is_float(a) || !snek_vector3_is_float(b)) {
+        return NULL;
+      }
+      snek_vector3_load(a, x);
+      snek_vector3_load(b, y);
+
+      void (*kernel)(float*, const float*, const float*, size_t) =
+          op == SNEK_ADD   ? simd->add_float
+          : op == SNEK_SUB ? simd->sub_float
+                           : simd->mul_float;
+      kernel(out, x, y, 3);
+      return new_snek_vector3_from_lanes(vm, out);
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+snek_object_t* snek_add_elementwise(vm_t* vm, snek_object_t* a,
+                                    snek_object_t* b) {
+  return snek_elementwise(vm, SNEK_ADD, a, b);
+}
+
+snek_object_t* snek_sub_elementwise(vm_t* vm, snek_object_t* a,
+                                    snek_object_t* b) {
+  return snek_elementwise(vm, SNEK_SUB, a, b);
+}
+
+snek_object_t* snek_mul_elementwise(vm_t* vm, snek_object_t* a,
+                                    snek_object_t* b) {
+  return snek_elementwise(vm, SNEK_MUL, a, b);
+}
+
+// Multiplies every element by factor. The result is always made of floats,
+// an int array comes back as a float array.
+snek_object_t* snek_scale(vm_t* vm, snek_object_t* obj, float factor) {
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  const simd_kernels_t* simd = simd_kernels();
+  switch (obj->kind) {
+    case INT_ARRAY: {
+      size_t size = obj->data.v_int_array.size;
+      snek_object_t* arr = new_snek_float_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      float* out = arr->data.v_float_array.elements;
+      simd->int_to_float(out, obj->data.v_int_array.elements, size);
+      simd->scale_float(out, out, factor, size);
+      return arr;
+    }
+
+    case FLOAT_ARRAY: {
+      size_t size = obj->data.v_float_array.size;
+      snek_object_t* arr = new_snek_float_array(vm, size);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      simd->scale_float(arr->data.v_float_array.elements,
+                        obj->data.v_float_array.elements, factor, size);
+      return arr;
+    }
+
+    case VECTOR3: {
+      float lanes[3];
+      if (!snek_vector3_load(obj, lanes)) {
+        return NULL;
+      }
+
+      simd->scale_float(lanes, lanes, factor, 3);
+      return new_snek_vector3_from_lanes(vm, lanes);
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+// Dot product of two typed arrays of the same kind and length, or of two
+// VECTOR3s of numbers, returned as a FLOAT. Int arrays are promoted to floats
+// first, like snek_scale does.
+snek_object_t* snek_dot(vm_t* vm, snek_object_t* a, snek_object_t* b) {
+  if (!a || !b || a->kind != b->kind) {
+    return NULL;
+  }
+
+  const simd_kernels_t* simd = simd_kernels();
+  switch (a->kind) {
+    case INT_ARRAY: {
+      size_t size = a->data.v_int_array.size;
+      if (b->data.v_int_array.size != size) {
+        return NULL;
+      }
+
+      // One extra byte, so empty arrays don't hit malloc(0) returning NULL
+      float* x = malloc(2 * size * sizeof(float) + 1);
+      if (x == NULL) {
+        return NULL;
+      }
+
+      float* y = x + size;
+      simd->int_to_float(x, a->data.v_int_array.elements, size);
+      simd->int_to_float(y, b->data.v_int_array.elements, size);
+      float dot = simd->dot_float(x, y, size);
+      free(x);
+      return new_snek_float(vm, dot);
+    }
+
+    case FLOAT_ARRAY: {
+      size_t size = a->data.v_float_array.size;
+      if (b->data.v_float_array.size != size) {
+        return NULL;
+      }
+
+      return new_snek_float(
+          vm, simd->dot_float(a->data.v_float_array.elements,
+                              b->data.v_float_array.elements, size));
+    }
+
+    case VECTOR3: {
+      float x[3], y[3];
+      if (!snek_vector3_load(a, x) || !snek_vector3_load(b, y)) {
+        return NULL;
+      }
+
+      return new_snek_float(vm, simd->dot_float(x, y, 3));
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+snek_object_t* snek_add(vm_t* vm, snek_object_t* a, snek_object_t* b) {
+  if (!a || !b) {
+    return NULL;
+  }
+
+  switch (a->kind) {
+    case INTEGER:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_integer(vm, a->data.v_int + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(vm, a->data.v_int + b->data.v_float);
+        case INT_ARRAY:
+        case FLOAT_ARRAY:
+          return snek_typed_array_add_scalar(vm, b, a);
+        default:
+          return NULL;
+      }
+
+    case FLOAT:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_float(vm, a->data.v_float + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(vm, a->data.v_float + b->data.v_float);
+        case INT_ARRAY:
+        case FLOAT_ARRAY:
+          return snek_typed_array_add_scalar(vm, b, a);
+        default:
+          return NULL;
+      }
+
+    case STRING: {
+      if (b->kind != STRING) {
+        return NULL;
+      }
+
+      // +1 for null terminator
+      int new_len = strlen(a->data.v_string) + strlen(b->data.v_string) + 1;
+      char* tmp = calloc(sizeof(char), new_len);
+      if (tmp == NULL) {
+        return NULL;
+      }
+
+      strcat(tmp, a->data.v_string);
+      strcat(tmp, b->data.v_string);
+
+      snek_object_t* obj = new_snek_string(vm, tmp);
+      free(tmp);
+      return obj;
+    }
+
+    case VECTOR3:
+      if (b->kind != VECTOR3) {
+        return NULL;
+      }
+
+      if (snek_vector3_is_float(a) && snek_vector3_is_float(b)) {
+        return snek_elementwise(vm, SNEK_ADD, a, b);
+      }
+
+      return new_snek_vector3(
+          vm, snek_add(vm, a->data.v_vector3.x, b->data.v_vector3.x),
+          snek_add(vm, a->data.v_vector3.y, b->data.v_vector3.y),
+          snek_add(vm, a->data.v_vector3.z, b->data.v_vector3.z));
+
+    case ARRAY: {
+      if (b->kind != ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_array.size;
+      size_t b_len = b->data.v_array.size;
+      snek_object_t* arr = new_snek_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      for (size_t i = 0; i < a_len; ++i) {
+        snek_array_set(arr, i, snek_array_get(a, i));
+      }
+      for (size_t i = 0; i < b_len; ++i) {
+        snek_array_set(arr, a_len + i, snek_array_get(b, i));
+      }
+      return arr;
+    }
+
+    case INT_ARRAY: {
+      if (b->kind == INTEGER || b->kind == FLOAT) {
+        return snek_typed_array_add_scalar(vm, a, b);
+      }
+      if (b->kind != INT_ARRAY) {
+        return NULL;
+      }
+
+      // Two buffers copied back to back, no per-element work at all
+      size_t a_len = a->data.v_int_array.size;
+      size_t b_len = b->data.v_int_array.size;
+      snek_object_t* arr = new_snek_int_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      int* out = arr->data.v_int_array.elements;
+      memcpy(out, a->data.v_int_array.elements, a_len * sizeof(int));
+      memcpy(out + a_len, b->data.v_int_array.elements, b_len * sizeof(int));
+      return arr;
+    }
+
+    case FLOAT_ARRAY: {
+      if (b->kind == INTEGER || b->kind == FLOAT) {
+        return snek_typed_array_add_scalar(vm, a, b);
+      }
+      if (b->kind != FLOAT_ARRAY) {
+        return NULL;
+      }
+
+      size_t a_len = a->data.v_float_array.size;
+      size_t b_len = b->data.v_float_array.size;
+      snek_object_t* arr = new_snek_float_array(vm, a_len + b_len);
+      if (arr == NULL) {
+        return NULL;
+      }
+
+      float* out = arr->data.v_float_array.elements;
+      memcpy(out, a->data.v_float_array.elements, a_len * sizeof(float));
+      memcpy(out + a_len, b->data.v_float_array.elements,
+             b_len * sizeof(float));
+      return arr;
+    }
+
+    default:
+      return NULL;
+  }
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_add_elementwise(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new();
+
+  // 7 elements, so the scalar tail runs after one vector step
+  snek_object_t* a = new_snek_int_array(vm, 7);
+  snek_object_t* b = new_snek_int_array(vm, 7);
+  snek_object_t* fa = new_snek_float_array(vm, 7);
+  snek_object_t* fb = new_snek_float_array(vm, 7);
+  for (int i = 0; i < 7; ++i) {
+    a->data.v_int_array.elements[i] = i;
+    b->data.v_int_array.elements[i] = 10 * i;
+    fa->data.v_float_array.elements[i] = i + 0.5f;
+    fb->data.v_float_array.elements[i] = 0.25f;
+  }
+
+  snek_object_t* sum = snek_add_elementwise(vm, a, b);
+  munit_assert_int(sum->kind, ==, INT_ARRAY);
+  snek_object_t* fsum = snek_add_elementwise(vm, fa, fb);
+  munit_assert_int(fsum->kind, ==, FLOAT_ARRAY);
+  for (int i = 0; i < 7; ++i) {
+    munit_assert_int(sum->data.v_int_array.elements[i], ==, 11 * i);
+    munit_assert_float(fsum->data.v_float_array.elements[i], ==, i + 0.75f);
+  }
+
+  // Kinds and lengths have to match
+  munit_assert_null(snek_add_elementwise(vm, a, fa));
+  munit_assert_null(snek_add_elementwise(vm, a, new_snek_int_array(vm, 6)));
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_add_scalar(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* a = new_snek_int_array(vm, 5);
+  for (int i = 0; i < 5; ++i) {
+    a->data.v_int_array.elements[i] = i;
+  }
+
+  snek_object_t* plus_int = snek_add(vm, a, new_snek_integer(vm, 100));
+  munit_assert_int(plus_int->kind, ==, INT_ARRAY);
+  snek_object_t* int_plus = snek_add(vm, new_snek_integer(vm, 100), a);
+  munit_assert_int(int_plus->kind, ==, INT_ARRAY);
+  snek_object_t* plus_float = snek_add(vm, a, new_snek_float(vm, 0.5));
+  munit_assert_int(plus_float->kind, ==, FLOAT_ARRAY);
+  snek_object_t* twice = snek_add(vm, plus_float, new_snek_integer(vm, 1));
+  munit_assert_int(twice->kind, ==, FLOAT_ARRAY);
+
+  for (int i = 0; i < 5; ++i) {
+    munit_assert_int(plus_int->data.v_int_array.elements[i], ==, i + 100);
+    munit_assert_int(int_plus->data.v_int_array.elements[i], ==, i + 100);
+    munit_assert_float(plus_float->data.v_float_array.elements[i], ==,
+                       i + 0.5f);
+    munit_assert_float(twice->data.v_float_array.elements[i], ==, i + 1.5f);
+  }
+
+  // The source array is untouched
+  munit_assert_int(a->data.v_int_array.elements[4], ==, 4);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_levels_agree(const MunitParameter params[],
+                                     void* data) {
+  // 37 elements, so every level runs its vector loop and its tail. Small
+  // whole numbers keep float sums exact in any order.
+  enum { COUNT = 37 };
+  int ia[COUNT], ib[COUNT];
+  float fa[COUNT], fb[COUNT];
+  for (int i = 0; i < COUNT; ++i) {
+    ia[i] = i * 7 - 100;
+    ib[i] = 3 - i;
+    fa[i] = i - 18;
+    fb[i] = (i % 5) + 0.5f;
+  }
+  ia[0] = 2147483647;  // wraps the same way everywhere
+
+  const simd_kernels_t* scalar = simd_kernels_for(SIMD_SCALAR);
+  int want_int[4][COUNT];
+  float want_float[6][COUNT];
+  scalar->add_int(want_int[0], ia, ib, COUNT);
+  scalar->sub_int(want_int[1], ia, ib, COUNT);
+  scalar->mul_int(want_int[2], ia, ib, COUNT);
+  scalar->add_int_scalar(want_int[3], ia, 5, COUNT);
+  scalar->add_float(want_float[0], fa, fb, COUNT);
+  scalar->sub_float(want_float[1], fa, fb, COUNT);
+  scalar->mul_float(want_float[2], fa, fb, COUNT);
+  scalar->add_float_scalar(want_float[3], fa, 0.25f, COUNT);
+  scalar->scale_float(want_float[4], fa, -2.0f, COUNT);
+  scalar->int_to_float(want_float[5], ib, COUNT);
+  float want_dot = scalar->dot_float(fa, fb, COUNT);
+
+  for (int level = SIMD_SCALAR; level <= SIMD_AVX2; ++level) {
+    const simd_kernels_t* simd = simd_kernels_for(level);
+    if (simd == NULL) {
+      continue;
+    }
+
+    int got_int[4][COUNT];
+    float got_float[6][COUNT];
+    simd->add_int(got_int[0], ia, ib, COUNT);
+    simd->sub_int(got_int[1], ia, ib, COUNT);
+    simd->mul_int(got_int[2], ia, ib, COUNT);
+    simd->add_int_scalar(got_int[3], ia, 5, COUNT);
+    simd->add_float(got_float[0], fa, fb, COUNT);
+    simd->sub_float(got_float[1], fa, fb, COUNT);
+    simd->mul_float(got_float[2], fa, fb, COUNT);
+    simd->add_float_scalar(got_float[3], fa, 0.25f, COUNT);
+    simd->scale_float(got_float[4], fa, -2.0f, COUNT);
+    simd->int_to_float(got_float[5], ib, COUNT);
+
+    munit_assert_memory_equal(sizeof(want_int), got_int, want_int);
+    munit_assert_memory_equal(sizeof(want_float), got_float, want_float);
+    munit_assert_float(simd->dot_float(fa, fb, COUNT), ==, want_dot);
+  }
+
+  // Pinning a level sticks until the next call
+  munit_assert_true(simd_use(SIMD_SCALAR));
+  munit_assert_int(simd_kernels()->level, ==, SIMD_SCALAR);
+  simd_active = NULL;
+  munit_assert_not_null(simd_kernels());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_ops(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* a = new_snek_float_array(vm, 20);
+  snek_object_t* b = new_snek_float_array(vm, 20);
+  snek_object_t* ints = new_snek_int_array(vm, 20);
+  for (int i = 0; i < 20; ++i) {
+    a->data.v_float_array.elements[i] = i;
+    b->data.v_float_array.elements[i] = 2.0f;
+    ints->data.v_int_array.elements[i] = i;
+  }
+
+  snek_object_t* diff = snek_sub_elementwise(vm, a, b);
+  snek_object_t* prod = snek_mul_elementwise(vm, a, b);
+  snek_object_t* squares = snek_mul_elementwise(vm, ints, ints);
+  snek_object_t* halves = snek_scale(vm, ints, 0.5f);
+  munit_assert_int(squares->kind, ==, INT_ARRAY);
+  munit_assert_int(halves->kind, ==, FLOAT_ARRAY);
+  for (int i = 0; i < 20; ++i) {
+    munit_assert_float(diff->data.v_float_array.elements[i], ==, i - 2.0f);
+    munit_assert_float(prod->data.v_float_array.elements[i], ==, i * 2.0f);
+    munit_assert_int(squares->data.v_int_array.elements[i], ==, i * i);
+    munit_assert_float(halves->data.v_float_array.elements[i], ==, i * 0.5f);
+  }
+
+  // 2 * (0 + 1 + ... + 19)
+  snek_object_t* dot = snek_dot(vm, a, b);
+  munit_assert_int(dot->kind, ==, FLOAT);
+  munit_assert_float(dot->data.v_float, ==, 380.0f);
+  munit_assert_null(snek_dot(vm, a, ints));
+
+  // 0^2 + 1^2 + ... + 19^2
+  snek_object_t* int_dot = snek_dot(vm, ints, ints);
+  munit_assert_int(int_dot->kind, ==, FLOAT);
+  munit_assert_float(int_dot->data.v_float, ==, 2470.0f);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+
+  snek_object_t* v1 =
+      new_snek_vector3(vm, new_snek_float(vm, 1.0), new_snek_float(vm, 2.0),
+                       new_snek_float(vm, 3.0));
+  snek_object_t* v2 =
+      new_snek_vector3(vm, new_snek_float(vm, 0.5), new_snek_float(vm, 0.5),
+                       new_snek_float(vm, -1.0));
+
+  snek_object_t* sum = snek_add(vm, v1, v2);
+  munit_assert_int(sum->kind, ==, VECTOR3);
+  munit_assert_float(sum->data.v_vector3.x->data.v_float, ==, 1.5f);
+  munit_assert_float(sum->data.v_vector3.y->data.v_float, ==, 2.5f);
+  munit_assert_float(sum->data.v_vector3.z->data.v_float, ==, 2.0f);
+
+  snek_object_t* diff = snek_sub_elementwise(vm, v1, v2);
+  munit_assert_float(diff->data.v_vector3.z->data.v_float, ==, 4.0f);
+
+  snek_object_t* dot = snek_dot(vm, v1, v2);
+  munit_assert_float(dot->data.v_float, ==, -1.5f);
+
+  // Int components still add as ints, they take the recursive path
+  snek_object_t* iv =
+      new_snek_vector3(vm, new_snek_integer(vm, 1), new_snek_integer(vm, 2),
+                       new_snek_integer(vm, 3));
+  snek_object_t* isum = snek_add(vm, iv, iv);
+  munit_assert_int(isum->data.v_vector3.y->kind, ==, INTEGER);
+  munit_assert_int(isum->data.v_vector3.y->data.v_int, ==, 4);
+
+  // Scaling and dot products promote them
+  snek_object_t* scaled = snek_scale(vm, iv, 2.0f);
+  munit_assert_int(scaled->data.v_vector3.z->kind, ==, FLOAT);
+  munit_assert_float(scaled->data.v_vector3.z->data.v_float, ==, 6.0f);
+  munit_assert_float(snek_dot(vm, iv, v1)->data.v_float, ==, 14.0f);
+
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_levels_agree", test_levels_agree, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_add_elementwise", test_add_elementwise, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_add_scalar", test_add_scalar, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_array_ops", test_array_ops, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_vector3", test_vector3, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "simd-kernels",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
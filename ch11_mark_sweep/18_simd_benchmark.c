@@ -0,0 +1,538 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+// No bootlib here, we want to time the real allocator.
+//-----------------------------------------------------------------------------
+//---------------------------------- SIMD--------------------------------------
+// One table of kernels per instruction set. simd_kernels() picks the widest
+// table the CPU supports the first time it is called, so one binary runs
+// everywhere and still uses AVX2 where it exists. Each vector kernel hands
+// its tail to the scalar one, buffers need no particular length or alignment.
+// Int kernels wrap on overflow, the same as the vector instructions.
+typedef enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+} simd_level_t;
+
+typedef struct SimdKernels {
+  simd_level_t level;
+  const char* name;
+  void (*add_int)(int* out, const int* a, const int* b, size_t count);
+  void (*sub_int)(int* out, const int* a, const int* b, size_t count);
+  void (*mul_int)(int* out, const int* a, const int* b, size_t count);
+  void (*add_int_scalar)(int* out, const int* a, int b, size_t count);
+  void (*add_float)(float* out, const float* a, const float* b, size_t count);
+  void (*sub_float)(float* out, const float* a, const float* b, size_t count);
+  void (*mul_float)(float* out, const float* a, const float* b, size_t count);
+  void (*add_float_scalar)(float* out, const float* a, float b, size_t count);
+  void (*scale_float)(float* out, const float* a, float factor, size_t count);
+  float (*dot_float)(const float* a, const float* b, size_t count);
+  void (*int_to_float)(float* out, const int* a, size_t count);
+} simd_kernels_t;
+
+static void scalar_add_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b[i]);
+  }
+}
+
+static void scalar_sub_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] - (unsigned)b[i]);
+  }
+}
+
+static void scalar_mul_int(int* out, const int* a, const int* b,
+                           size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] * (unsigned)b[i]);
+  }
+}
+
+static void scalar_add_int_scalar(int* out, const int* a, int b,
+                                  size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (int)((unsigned)a[i] + (unsigned)b);
+  }
+}
+
+static void scalar_add_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] + b[i];
+  }
+}
+
+static void scalar_sub_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] - b[i];
+  }
+}
+
+static void scalar_mul_float(float* out, const float* a, const float* b,
+                             size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] * b[i];
+  }
+}
+
+static void scalar_add_float_scalar(float* out, const float* a, float b,
+                                    size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] + b;
+  }
+}
+
+static void scalar_scale_float(float* out, const float* a, float factor,
+                               size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = a[i] * factor;
+  }
+}
+
+static float scalar_dot_float(const float* a, const float* b, size_t count) {
+  float sum = 0.0f;
+  for (size_t i = 0; i < count; ++i) {
+    sum += a[i] * b[i];
+  }
+  return sum;
+}
+
+static void scalar_int_to_float(float* out, const int* a, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = (float)a[i];
+  }
+}
+
+static const simd_kernels_t simd_scalar_kernels = {
+    .level = SIMD_SCALAR,
+    .name = "scalar",
+    .add_int = scalar_add_int,
+    .sub_int = scalar_sub_int,
+    .mul_int = scalar_mul_int,
+    .add_int_scalar = scalar_add_int_scalar,
+    .add_float = scalar_add_float,
+    .sub_float = scalar_sub_float,
+    .mul_float = scalar_mul_float,
+    .add_float_scalar = scalar_add_float_scalar,
+    .scale_float = scalar_scale_float,
+    .dot_float = scalar_dot_float,
+    .int_to_float = scalar_int_to_float,
+};
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+// The target attributes let these compile without -msse2/-mavx2, only the
+// dispatcher decides whether they ever run.
+#define SIMD_SSE2_TARGET __attribute__((target("sse2")))
+#define SIMD_AVX2_TARGET __attribute__((target("avx2")))
+
+static SIMD_SSE2_TARGET void sse2_add_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+  scalar_add_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_sub_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_sub_epi32(x, y));
+  }
+  scalar_sub_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_int_scalar(int* out, const int* a, int b,
+                                                 size_t count) {
+  size_t i = 0;
+  __m128i y = _mm_set1_epi32(b);
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_si128((__m128i*)(out + i), _mm_add_epi32(x, y));
+  }
+  scalar_add_int_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_add_ps(x, y));
+  }
+  scalar_add_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_sub_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_sub_ps(x, y));
+  }
+  scalar_sub_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_mul_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128 x = _mm_loadu_ps(a + i);
+    __m128 y = _mm_loadu_ps(b + i);
+    _mm_storeu_ps(out + i, _mm_mul_ps(x, y));
+  }
+  scalar_mul_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_add_float_scalar(float* out, const float* a,
+                                                   float b, size_t count) {
+  size_t i = 0;
+  __m128 y = _mm_set1_ps(b);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), y));
+  }
+  scalar_add_float_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_scale_float(float* out, const float* a,
+                                              float factor, size_t count) {
+  size_t i = 0;
+  __m128 y = _mm_set1_ps(factor);
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), y));
+  }
+  scalar_scale_float(out + i, a + i, factor, count - i);
+}
+
+static SIMD_SSE2_TARGET float sse2_dot_float(const float* a, const float* b,
+                                             size_t count) {
+  size_t i = 0;
+  __m128 sum = _mm_setzero_ps();
+  for (; i + 4 <= count; i += 4) {
+    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+  }
+
+  float lanes[4];
+  _mm_storeu_ps(lanes, sum);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+         scalar_dot_float(a + i, b + i, count - i);
+}
+
+static SIMD_SSE2_TARGET void sse2_int_to_float(float* out, const int* a,
+                                               size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    _mm_storeu_ps(out + i, _mm_cvtepi32_ps(x));
+  }
+  scalar_int_to_float(out + i, a + i, count - i);
+}
+
+// SSE2 has no 32-bit multiply that keeps the low halves (that is SSE4.1), so
+// mul_int stays scalar at this level.
+static const simd_kernels_t simd_sse2_kernels = {
+    .level = SIMD_SSE2,
+    .name = "sse2",
+    .add_int = sse2_add_int,
+    .sub_int = sse2_sub_int,
+    .mul_int = scalar_mul_int,
+    .add_int_scalar = sse2_add_int_scalar,
+    .add_float = sse2_add_float,
+    .sub_float = sse2_sub_float,
+    .mul_float = sse2_mul_float,
+    .add_float_scalar = sse2_add_float_scalar,
+    .scale_float = sse2_scale_float,
+    .dot_float = sse2_dot_float,
+    .int_to_float = sse2_int_to_float,
+};
+
+static SIMD_AVX2_TARGET void avx2_add_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(x, y));
+  }
+  scalar_add_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_sub_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_sub_epi32(x, y));
+  }
+  scalar_sub_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_mul_int(int* out, const int* a, const int* b,
+                                          size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    __m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_mullo_epi32(x, y));
+  }
+  scalar_mul_int(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_int_scalar(int* out, const int* a, int b,
+                                                 size_t count) {
+  size_t i = 0;
+  __m256i y = _mm256_set1_epi32(b);
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    _mm256_storeu_si256((__m256i*)(out + i), _mm256_add_epi32(x, y));
+  }
+  scalar_add_int_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_add_ps(x, y));
+  }
+  scalar_add_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_sub_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_sub_ps(x, y));
+  }
+  scalar_sub_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_mul_float(float* out, const float* a,
+                                            const float* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256 x = _mm256_loadu_ps(a + i);
+    __m256 y = _mm256_loadu_ps(b + i);
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(x, y));
+  }
+  scalar_mul_float(out + i, a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_add_float_scalar(float* out, const float* a,
+                                                   float b, size_t count) {
+  size_t i = 0;
+  __m256 y = _mm256_set1_ps(b);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), y));
+  }
+  scalar_add_float_scalar(out + i, a + i, b, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_scale_float(float* out, const float* a,
+                                              float factor, size_t count) {
+  size_t i = 0;
+  __m256 y = _mm256_set1_ps(factor);
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), y));
+  }
+  scalar_scale_float(out + i, a + i, factor, count - i);
+}
+
+static SIMD_AVX2_TARGET float avx2_dot_float(const float* a, const float* b,
+                                             size_t count) {
+  // Two accumulators, so each add doesn't wait on the one before it
+  size_t i = 0;
+  __m256 sum0 = _mm256_setzero_ps();
+  __m256 sum1 = _mm256_setzero_ps();
+  for (; i + 16 <= count; i += 16) {
+    __m256 x0 = _mm256_loadu_ps(a + i);
+    __m256 x1 = _mm256_loadu_ps(a + i + 8);
+    sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(x0, _mm256_loadu_ps(b + i)));
+    sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(x1, _mm256_loadu_ps(b + i + 8)));
+  }
+
+  float lanes[8];
+  _mm256_storeu_ps(lanes, _mm256_add_ps(sum0, sum1));
+  float sum = 0.0f;
+  for (int lane = 0; lane < 8; ++lane) {
+    sum += lanes[lane];
+  }
+  return sum + scalar_dot_float(a + i, b + i, count - i);
+}
+
+static SIMD_AVX2_TARGET void avx2_int_to_float(float* out, const int* a,
+                                               size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+    _mm256_storeu_ps(out + i, _mm256_cvtepi32_ps(x));
+  }
+  scalar_int_to_float(out + i, a + i, count - i);
+}
+
+static const simd_kernels_t simd_avx2_kernels = {
+    .level = SIMD_AVX2,
+    .name = "avx2",
+    .add_int = avx2_add_int,
+    .sub_int = avx2_sub_int,
+    .mul_int = avx2_mul_int,
+    .add_int_scalar = avx2_add_int_scalar,
+    .add_float = avx2_add_float,
+    .sub_float = avx2_sub_float,
+    .mul_float = avx2_mul_float,
+    .add_float_scalar = avx2_add_float_scalar,
+    .scale_float = avx2_scale_float,
+    .dot_float = avx2_dot_float,
+    .int_to_float = avx2_int_to_float,
+};
+#endif
+
+static const simd_kernels_t* simd_active = NULL;
+
+// Returns the table for a level, or NULL when this CPU can't run it
+const simd_kernels_t* simd_kernels_for(simd_level_t level) {
+  switch (level) {
+    case SIMD_SCALAR:
+      return &simd_scalar_kernels;
+#if defined(SIMD_X86)
+    case SIMD_SSE2:
+      return __builtin_cpu_supports("sse2") ? &simd_sse2_kernels : NULL;
+    case SIMD_AVX2:
+      return __builtin_cpu_supports("avx2") ? &simd_avx2_kernels : NULL;
+#endif
+    default:
+      return NULL;
+  }
+}
+
+const simd_kernels_t* simd_kernels() {
+  if (simd_active == NULL) {
+    for (int level = SIMD_AVX2; level >= SIMD_SCALAR; --level) {
+      simd_active = simd_kernels_for(level);
+      if (simd_active != NULL) {
+        break;
+      }
+    }
+  }
+  return simd_active;
+}
+
+// Pins every caller to one level, for tests and benchmarks
+bool simd_use(simd_level_t level) {
+  const simd_kernels_t* kernels = simd_kernels_for(level);
+  if (kernels == NULL) {
+    return false;
+  }
+
+  simd_active = kernels;
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------Benchmark-----------------------------------
+// A million floats is 4 MB per buffer, well past L2, so a kernel that keeps
+// up with memory is as fast as it gets. Throughput counts every byte read and
+// written.
+#define ELEMENTS 1000000
+#define ROUNDS 200
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct BenchResult {
+  double add_seconds;
+  double dot_seconds;
+  double checksum;
+} bench_result_t;
+
+static bench_result_t bench_level(const simd_kernels_t* simd, const float* a,
+                                  const float* b, float* out) {
+  bench_result_t result = {0};
+
+  double start = now_seconds();
+  for (int round = 0; round < ROUNDS; ++round) {
+    simd->add_float(out, a, b, ELEMENTS);
+    result.checksum += out[round];
+  }
+  result.add_seconds = (now_seconds() - start) / ROUNDS;
+
+  start = now_seconds();
+  for (int round = 0; round < ROUNDS; ++round) {
+    result.checksum += simd->dot_float(a, b, ELEMENTS);
+  }
+  result.dot_seconds = (now_seconds() - start) / ROUNDS;
+
+  return result;
+}
+
+int main() {
+  float* a = malloc(ELEMENTS * sizeof(float));
+  float* b = malloc(ELEMENTS * sizeof(float));
+  float* out = malloc(ELEMENTS * sizeof(float));
+  if (a == NULL || b == NULL || out == NULL) {
+    return 1;
+  }
+
+  // Small whole numbers, so every level sums the dot product exactly
+  for (int i = 0; i < ELEMENTS; ++i) {
+    a[i] = i % 7;
+    b[i] = (i % 3) - 1;
+  }
+
+  printf("%d floats, %d rounds\n", ELEMENTS, ROUNDS);
+  double add_bytes = 3.0 * ELEMENTS * sizeof(float);
+  double dot_bytes = 2.0 * ELEMENTS * sizeof(float);
+  double scalar_checksum = 0.0;
+  for (int level = SIMD_SCALAR; level <= SIMD_AVX2; ++level) {
+    const simd_kernels_t* simd = simd_kernels_for(level);
+    if (simd == NULL) {
+      continue;
+    }
+
+    bench_result_t result = bench_level(simd, a, b, out);
+    if (level == SIMD_SCALAR) {
+      scalar_checksum = result.checksum;
+    } else if (result.checksum != scalar_checksum) {
+      printf("checksum mismatch: %f != %f\n", result.checksum,
+             scalar_checksum);
+      return 1;
+    }
+
+    printf("  %-6s add: %.3f ms (%.1f GB/s)  dot: %.3f ms (%.1f GB/s)\n",
+           simd->name, result.add_seconds * 1e3,
+           add_bytes / result.add_seconds / 1e9, result.dot_seconds * 1e3,
+           dot_bytes / result.dot_seconds / 1e9);
+  }
+
+  free(a);
+  free(b);
+  free(out);
+  return 0;
+}
@@ -0,0 +1,480 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+#include "assert.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+// Fixed-size objects are carved out of large pages. Released objects are
+// threaded onto an intrusive free list and handed out again before any new
+// page is touched, so alloc and release are a couple of pointer ops.
+#define POOL_PAGE_SIZE (64 * 1024)
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  char objects[];
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t count;  // live objects
+  pool_page_t* pages;
+  pool_slot_t* free_list;
+  char* bump;  // next never-used object in the newest page
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // Every slot must be able to hold the free list link, and stay aligned
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  pool->object_size = object_size;
+  pool->objects_per_page =
+      (POOL_PAGE_SIZE - sizeof(pool_page_t)) / object_size;
+  pool->count = 0;
+  pool->pages = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  pool_page_t* page = malloc(POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = pool->pages;
+  pool->pages = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  // Same contract as the calloc it replaces
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_slot_t* slot = obj;
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  pool->count--;
+}
+
+void pool_free(pool_t* pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+// All snek objects share one pool, created on first use
+static pool_t* snek_object_pool = NULL;
+
+void snek_object_pool_free(void) {
+  pool_free(snek_object_pool);
+  snek_object_pool = NULL;
+}
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+snek_object_t* new_snek_array(size_t size);
+
+void refcount_inc(snek_object_t* obj);
+void refcount_dec(snek_object_t* obj);
+void refcount_free(snek_object_t* obj);
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index);
+
+bool snek_array_set(snek_object_t* snek_obj, size_t index,
+                    snek_object_t* value) {
+  if (snek_obj == NULL || value == NULL) {
+    return false;
+  }
+  if (snek_obj->kind != ARRAY) {
+    return false;
+  }
+  if (index >= snek_obj->data.v_array.size) {
+    return false;
+  }
+  refcount_dec(snek_obj->data.v_array.elements[index]);
+  snek_obj->data.v_array.elements[index] = value;
+  refcount_inc(value);
+  return true;
+}
+
+void refcount_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      snek_vector_t vec = obj->data.v_vector3;
+      refcount_dec(vec.x);
+      refcount_dec(vec.y);
+      refcount_dec(vec.z);
+      break;
+    }
+    case ARRAY:
+      for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+        refcount_dec(obj->data.v_array.elements[i]);
+      }
+      free(obj->data.v_array.elements);
+      break;
+    default:
+      assert(false);
+  }
+  pool_release(snek_object_pool, obj);
+}
+
+snek_object_t* snek_array_get(snek_object_t* snek_obj, size_t index) {
+  if (snek_obj == NULL) {
+    return NULL;
+  }
+
+  if (snek_obj->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= snek_obj->data.v_array.size) {
+    return NULL;
+  }
+
+  return snek_obj->data.v_array.elements[index];
+}
+
+void refcount_inc(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  obj->refcount++;
+  return;
+}
+
+void refcount_dec(snek_object_t* obj) {
+  if (obj == NULL) {
+    return;
+  }
+  obj->refcount--;
+  if (obj->refcount == 0) {
+    return refcount_free(obj);
+  }
+  return;
+}
+
+snek_object_t* _new_snek_object() {
+  if (snek_object_pool == NULL) {
+    snek_object_pool = pool_new(sizeof(snek_object_t));
+    if (snek_object_pool == NULL) {
+      return NULL;
+    }
+  }
+
+  snek_object_t* obj = pool_alloc(snek_object_pool);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+
+  return obj;
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    pool_release(snek_object_pool, obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    pool_release(snek_object_pool, obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+  snek_object_t* obj = _new_snek_object();
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+  refcount_inc(x);
+  refcount_inc(y);
+  refcount_inc(z);
+  return obj;
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_pool_reuses_slots(const MunitParameter params[],
+                                          void* data) {
+  pool_t* pool = pool_new(sizeof(snek_object_t));
+  munit_assert_not_null(pool);
+
+  void* a = pool_alloc(pool);
+  void* b = pool_alloc(pool);
+  munit_assert_ptr_not_equal(a, b);
+  // Neighbours in the same page
+  munit_assert_ptr_equal((char*)a + pool->object_size, b);
+  munit_assert_int(pool->count, ==, 2);
+
+  pool_release(pool, a);
+  munit_assert_int(pool->count, ==, 1);
+  munit_assert_ptr_equal(pool_alloc(pool), a);
+
+  pool_free(pool);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_pool_grows_pages(const MunitParameter params[],
+                                         void* data) {
+  pool_t* pool = pool_new(sizeof(snek_object_t));
+  size_t n = pool->objects_per_page * 3 + 1;
+
+  for (size_t i = 0; i < n; ++i) {
+    munit_assert_not_null(pool_alloc(pool));
+  }
+  munit_assert_int(pool->count, ==, n);
+  // 4 pages plus the pool itself
+  munit_assert_int(boot_stats().live_count, ==, 5);
+
+  pool_free(pool);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_objects_zeroed(const MunitParameter params[],
+                                       void* data) {
+  snek_object_t* foo = new_snek_integer(42);
+  refcount_dec(foo);
+
+  // The recycled slot must not leak the old object's fields
+  snek_object_t* array = new_snek_array(1);
+  munit_assert_ptr_equal(array, foo);
+  munit_assert_int(array->refcount, ==, 1);
+  munit_assert_null(snek_array_get(array, 0));
+
+  refcount_dec(array);
+  munit_assert_int(snek_object_pool->count, ==, 0);
+
+  snek_object_pool_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_free(const MunitParameter params[], void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_integer(3);
+  snek_object_t* array = new_snek_array(2);
+
+  snek_array_set(array, 0, foo);
+  snek_array_set(array, 1, bar);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(bar->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 1);
+
+  refcount_dec(foo);
+  snek_array_set(array, 0, baz);
+  munit_assert_int(snek_object_pool->count, ==, 3);
+
+  refcount_dec(bar);
+  refcount_dec(baz);
+  refcount_dec(array);
+  munit_assert_int(snek_object_pool->count, ==, 0);
+
+  snek_object_pool_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_refcounting(const MunitParameter params[],
+                                            void* data) {
+  snek_object_t* foo = new_snek_integer(1);
+  snek_object_t* bar = new_snek_integer(2);
+  snek_object_t* baz = new_snek_string("snek");
+  snek_object_t* vec = new_snek_vector3(foo, bar, baz);
+
+  munit_assert_int(foo->refcount, ==, 2);
+  munit_assert_int(baz->refcount, ==, 2);
+
+  refcount_dec(foo);
+  refcount_dec(bar);
+  refcount_dec(baz);
+  munit_assert_int(snek_object_pool->count, ==, 4);
+
+  refcount_dec(vec);
+  munit_assert_int(snek_object_pool->count, ==, 0);
+
+  snek_object_pool_free();
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/reuses_slots", test_pool_reuses_slots, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/grows_pages", test_pool_grows_pages, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/objects_zeroed", test_objects_zeroed, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/array_free", test_array_free, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/vector3", test_vector3_refcounting, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {"/pool", tests, NULL, 1, MUNIT_SUITE_OPTION_NONE};
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
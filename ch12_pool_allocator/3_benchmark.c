@@ -0,0 +1,240 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// No bootlib here, we want to time the real allocator.
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+#define POOL_PAGE_SIZE (64 * 1024)
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  char objects[];
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t count;  // live objects
+  pool_page_t* pages;
+  pool_slot_t* free_list;
+  char* bump;  // next never-used object in the newest page
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  pool->object_size = object_size;
+  pool->objects_per_page =
+      (POOL_PAGE_SIZE - sizeof(pool_page_t)) / object_size;
+  pool->count = 0;
+  pool->pages = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  pool_page_t* page = malloc(POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = pool->pages;
+  pool->pages = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_slot_t* slot = obj;
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  pool->count--;
+}
+
+void pool_free(pool_t* pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  int refcount;
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+static pool_t* snek_object_pool = NULL;
+
+snek_object_t* new_snek_integer_calloc(int value) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_integer_pool(int value) {
+  snek_object_t* obj = pool_alloc(snek_object_pool);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->refcount = 1;
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Benchmark-----------------------------------
+// Keep a window of live integers and replace one per iteration, so frees and
+// allocations interleave the way a running interpreter's do.
+#define CHURN_ITERATIONS 10000000
+#define LIVE_WINDOW 4096
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double churn_calloc(long* checksum) {
+  snek_object_t* window[LIVE_WINDOW] = {0};
+
+  double start = now_seconds();
+  for (int i = 0; i < CHURN_ITERATIONS; ++i) {
+    size_t slot = (size_t)i * 2654435761u % LIVE_WINDOW;
+    if (window[slot] != NULL) {
+      *checksum += window[slot]->data.v_int;
+      free(window[slot]);
+    }
+    window[slot] = new_snek_integer_calloc(i);
+  }
+  for (size_t i = 0; i < LIVE_WINDOW; ++i) {
+    free(window[i]);
+  }
+  return now_seconds() - start;
+}
+
+static double churn_pool(long* checksum) {
+  snek_object_t* window[LIVE_WINDOW] = {0};
+
+  double start = now_seconds();
+  snek_object_pool = pool_new(sizeof(snek_object_t));
+  for (int i = 0; i < CHURN_ITERATIONS; ++i) {
+    size_t slot = (size_t)i * 2654435761u % LIVE_WINDOW;
+    if (window[slot] != NULL) {
+      *checksum += window[slot]->data.v_int;
+      pool_release(snek_object_pool, window[slot]);
+    }
+    window[slot] = new_snek_integer_pool(i);
+  }
+  pool_free(snek_object_pool);
+  snek_object_pool = NULL;
+  return now_seconds() - start;
+}
+
+int main() {
+  long calloc_checksum = 0;
+  long pool_checksum = 0;
+
+  double calloc_time = churn_calloc(&calloc_checksum);
+  double pool_time = churn_pool(&pool_checksum);
+
+  if (calloc_checksum != pool_checksum) {
+    printf("checksum mismatch: %ld != %ld\n", calloc_checksum, pool_checksum);
+    return 1;
+  }
+
+  printf("churn of %d integers, %d live\n", CHURN_ITERATIONS, LIVE_WINDOW);
+  printf("  calloc/free:        %.3f s (%.1f ns/op)\n", calloc_time,
+         calloc_time * 1e9 / CHURN_ITERATIONS);
+  printf("  pool_alloc/release: %.3f s (%.1f ns/op)\n", pool_time,
+         pool_time * 1e9 / CHURN_ITERATIONS);
+  printf("  speedup:            %.2fx\n", calloc_time / pool_time);
+
+  return 0;
+}
@@ -0,0 +1,718 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+// Fixed-size objects are carved out of page-aligned pages. Each page keeps
+// two side bitmaps in its header, one bit per slot: which slots are
+// allocated and which were marked by the last trace. The mark bits never
+// touch the objects, clearing them is a memset and the sweep looks at 64
+// slots per word.
+#define POOL_PAGE_SIZE (64 * 1024)
+#define POOL_WORD_BITS 64
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  size_t object_size;
+  size_t words;  // bitmap words, ceil(objects_per_page / 64)
+  uint64_t* live;
+  uint64_t* marks;
+  char* objects;
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t words;
+  size_t count;  // live objects
+  pool_page_t* pages;
+  pool_slot_t* free_list;
+  char* bump;  // next never-used object in the newest page
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // Every slot must be able to hold the free list link, and stay aligned
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  // Each slot costs its size plus one live and one mark bit
+  size_t space = POOL_PAGE_SIZE - sizeof(pool_page_t);
+  size_t n = space * 8 / (object_size * 8 + 2);
+  size_t words = (n + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+  while (2 * words * sizeof(uint64_t) + n * object_size > space) {
+    n--;
+    words = (n + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+  }
+
+  pool->object_size = object_size;
+  pool->objects_per_page = n;
+  pool->words = words;
+  pool->count = 0;
+  pool->pages = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  // Aligned so any object finds its page header by masking its address
+  pool_page_t* page = aligned_alloc(POOL_PAGE_SIZE, POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = pool->pages;
+  page->object_size = pool->object_size;
+  page->words = pool->words;
+  page->live = (uint64_t*)(page + 1);
+  page->marks = page->live + pool->words;
+  page->objects = (char*)(page->marks + pool->words);
+  memset(page->live, 0, 2 * pool->words * sizeof(uint64_t));
+
+  pool->pages = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+static pool_page_t* pool_page_of(void* obj) {
+  return (pool_page_t*)((uintptr_t)obj & ~(uintptr_t)(POOL_PAGE_SIZE - 1));
+}
+
+static size_t pool_slot_of(pool_page_t* page, void* obj) {
+  return ((char*)obj - page->objects) / page->object_size;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  page->live[slot / POOL_WORD_BITS] |= 1ull << (slot % POOL_WORD_BITS);
+
+  // Same contract as the calloc it replaces
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  page->live[slot / POOL_WORD_BITS] &= ~(1ull << (slot % POOL_WORD_BITS));
+
+  pool_slot_t* free_slot = obj;
+  free_slot->next = pool->free_list;
+  pool->free_list = free_slot;
+  pool->count--;
+}
+
+bool pool_is_marked(void* obj) {
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  return page->marks[slot / POOL_WORD_BITS] & (1ull << (slot % POOL_WORD_BITS));
+}
+
+// Sets the mark bit, returns false if it was already set
+bool pool_mark(void* obj) {
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  uint64_t bit = 1ull << (slot % POOL_WORD_BITS);
+  uint64_t* word = &page->marks[slot / POOL_WORD_BITS];
+  if (*word & bit) {
+    return false;
+  }
+
+  *word |= bit;
+  return true;
+}
+
+void pool_clear_marks(pool_t* pool) {
+  for (pool_page_t* page = pool->pages; page != NULL; page = page->next) {
+    memset(page->marks, 0, page->words * sizeof(uint64_t));
+  }
+}
+
+void pool_free(pool_t* pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+// No mark flag here, marks live in the heap pages' bitmaps
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+void snek_object_free(pool_t* pool, snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  pool_release(pool, obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// The heap's live bitmaps already know every object, so there is no
+// separate objects stack to keep in sync.
+typedef struct VirtualMachine {
+  stack_t* frames;
+  pool_t* heap;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->heap = pool_new(sizeof(snek_object_t));
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  pool_free(vm->heap);
+  free(vm);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      pool_mark(obj);
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  // The roots are whatever mark() set, found a word at a time
+  size_t object_size = vm->heap->object_size;
+  for (pool_page_t* page = vm->heap->pages; page; page = page->next) {
+    for (size_t w = 0; w < page->words; ++w) {
+      uint64_t marked = page->marks[w];
+      while (marked) {
+        size_t slot = w * POOL_WORD_BITS + __builtin_ctzll(marked);
+        marked &= marked - 1;
+        stack_push(gray_objects, page->objects + slot * object_size);
+      }
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || !pool_mark(obj)) {
+    return;
+  }
+
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  pool_t* heap = vm->heap;
+  for (pool_page_t* page = heap->pages; page; page = page->next) {
+    for (size_t w = 0; w < page->words; ++w) {
+      uint64_t dead = page->live[w] & ~page->marks[w];
+      while (dead) {
+        size_t slot = w * POOL_WORD_BITS + __builtin_ctzll(dead);
+        dead &= dead - 1;
+        snek_object_free(heap, (snek_object_t*)(page->objects +
+                                                slot * heap->object_size));
+      }
+    }
+  }
+
+  pool_clear_marks(heap);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = pool_alloc(vm->heap);
+  if (obj == NULL) {
+    return NULL;
+  }
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    // Already live in the heap, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    // Already live in the heap, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_object_shrinks(const MunitParameter params[],
+                                       void* data) {
+  // kind + padding + the two-word union, the mark flag used to add a word
+  munit_assert_size(sizeof(snek_object_t), ==,
+                    sizeof(int) * 2 + sizeof(snek_object_data_t));
+  return MUNIT_OK;
+}
+
+static MunitResult test_simple(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "I wish I knew how to read.");
+  frame_reference_object(f1, s);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+  // Marks are cleared by the sweep, ready for the next cycle
+  munit_assert_false(pool_is_marked(s));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_trace_array(const MunitParameter params[],
+                                    void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Enough objects to span several bitmap words and pages
+  size_t n = vm->heap->objects_per_page * 2 + 3;
+  snek_object_t* array = new_snek_array(vm, n);
+  frame_reference_object(f1, array);
+  for (size_t i = 0; i < n; ++i) {
+    snek_array_set(array, i, new_snek_integer(vm, i));
+    new_snek_integer(vm, -1);  // garbage between each live one
+  }
+  munit_assert_int(vm->heap->count, ==, 2 * n + 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, n + 1);
+  for (size_t i = 0; i < n; ++i) {
+    munit_assert_int(snek_array_get(array, i)->data.v_int, ==, i);
+  }
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_full(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+  frame_t* f2 = vm_new_frame(vm);
+  frame_t* f3 = vm_new_frame(vm);
+
+  snek_object_t* s1 = new_snek_string(vm, "This string is going into frame 1");
+  frame_reference_object(f1, s1);
+
+  snek_object_t* s2 = new_snek_string(vm, "This string is going into frame 2");
+  frame_reference_object(f2, s2);
+
+  snek_object_t* s3 = new_snek_string(vm, "This string is going into frame 3");
+  frame_reference_object(f3, s3);
+
+  snek_object_t* i1 = new_snek_integer(vm, 69);
+  snek_object_t* i2 = new_snek_integer(vm, 420);
+  snek_object_t* i3 = new_snek_integer(vm, 1337);
+  snek_object_t* v = new_snek_vector3(vm, i1, i2, i3);
+
+  frame_reference_object(f2, v);
+  frame_reference_object(f3, v);
+
+  munit_assert_int(vm->heap->count, ==, 7);
+
+  // only free the top frame (f3)
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 6);
+
+  frame_free(vm_frame_pop(vm));
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_object_shrinks", test_object_shrinks, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_trace_array", test_trace_array, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_full", test_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "mark-bitmap",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,420 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// Mark and sweep time at 1M objects: the is_marked flag of
+// 2_mark_sweep_pool.c against the side bitmaps of 4_mark_bitmap.c.
+// Only INTEGER and ARRAY are needed to build the heap, so this file keeps
+// just those. No bootlib here, we want to time the real allocator.
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+#define POOL_PAGE_SIZE (64 * 1024)
+#define POOL_WORD_BITS 64
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  size_t object_size;
+  size_t words;
+  uint64_t* live;
+  uint64_t* marks;
+  char* objects;
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t words;
+  size_t count;
+  pool_page_t* pages;
+  pool_slot_t* free_list;
+  char* bump;
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  size_t space = POOL_PAGE_SIZE - sizeof(pool_page_t);
+  size_t n = space * 8 / (object_size * 8 + 2);
+  size_t words = (n + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+  while (2 * words * sizeof(uint64_t) + n * object_size > space) {
+    n--;
+    words = (n + POOL_WORD_BITS - 1) / POOL_WORD_BITS;
+  }
+
+  pool->object_size = object_size;
+  pool->objects_per_page = n;
+  pool->words = words;
+  pool->count = 0;
+  pool->pages = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  pool_page_t* page = aligned_alloc(POOL_PAGE_SIZE, POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = pool->pages;
+  page->object_size = pool->object_size;
+  page->words = pool->words;
+  page->live = (uint64_t*)(page + 1);
+  page->marks = page->live + pool->words;
+  page->objects = (char*)(page->marks + pool->words);
+  memset(page->live, 0, 2 * pool->words * sizeof(uint64_t));
+
+  pool->pages = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+static pool_page_t* pool_page_of(void* obj) {
+  return (pool_page_t*)((uintptr_t)obj & ~(uintptr_t)(POOL_PAGE_SIZE - 1));
+}
+
+static size_t pool_slot_of(pool_page_t* page, void* obj) {
+  return ((char*)obj - page->objects) / page->object_size;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  page->live[slot / POOL_WORD_BITS] |= 1ull << (slot % POOL_WORD_BITS);
+
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  page->live[slot / POOL_WORD_BITS] &= ~(1ull << (slot % POOL_WORD_BITS));
+
+  pool_slot_t* free_slot = obj;
+  free_slot->next = pool->free_list;
+  pool->free_list = free_slot;
+  pool->count--;
+}
+
+bool pool_mark(void* obj) {
+  pool_page_t* page = pool_page_of(obj);
+  size_t slot = pool_slot_of(page, obj);
+  uint64_t bit = 1ull << (slot % POOL_WORD_BITS);
+  uint64_t* word = &page->marks[slot / POOL_WORD_BITS];
+  if (*word & bit) {
+    return false;
+  }
+
+  *word |= bit;
+  return true;
+}
+
+void pool_clear_marks(pool_t* pool) {
+  for (pool_page_t* page = pool->pages; page != NULL; page = page->next) {
+    memset(page->marks, 0, page->words * sizeof(uint64_t));
+  }
+}
+
+void pool_free(pool_t* pool) {
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  return stack;
+}
+
+void stack_free(stack_t* stack) {
+  free(stack->data);
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+  stack->count = new_count;
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef enum SnekObjectKind {
+  INTEGER,
+  ARRAY,
+} snek_object_kind_t;
+
+// Same size as the real union, VECTOR3 is its largest member
+typedef union SnekObjectData {
+  int v_int;
+  void* v_vector3[3];
+  struct {
+    size_t size;
+    void** elements;
+  } v_array;
+} snek_object_data_t;
+
+typedef struct FlagObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} flag_object_t;
+
+typedef struct BitmapObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} bitmap_object_t;
+//-----------------------------------------------------------------------------
+//---------------------------------Benchmark-----------------------------------
+#define HEAP_OBJECTS 1000000
+#define ROUNDS 5
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct Timing {
+  double mark;
+  double sweep;
+} timing_t;
+
+// One live array holding every other integer, the rest is garbage
+static timing_t bench_flag(void) {
+  pool_t* heap = pool_new(sizeof(flag_object_t));
+  stack_t* objects = stack_new(8);
+
+  flag_object_t* root = pool_alloc(heap);
+  root->kind = ARRAY;
+  root->data.v_array.size = HEAP_OBJECTS / 2;
+  root->data.v_array.elements = calloc(HEAP_OBJECTS / 2, sizeof(void*));
+  stack_push(objects, root);
+  for (size_t i = 0; i < HEAP_OBJECTS; ++i) {
+    flag_object_t* obj = pool_alloc(heap);
+    obj->kind = INTEGER;
+    obj->data.v_int = i;
+    stack_push(objects, obj);
+    if (i % 2 == 0) {
+      root->data.v_array.elements[i / 2] = obj;
+    }
+  }
+
+  timing_t t;
+  double start = now_seconds();
+  root->is_marked = true;
+  stack_t* gray = stack_new(8);
+  for (size_t i = 0; i < objects->count; ++i) {
+    flag_object_t* obj = objects->data[i];
+    if (obj->is_marked) {
+      stack_push(gray, obj);
+    }
+  }
+  while (gray->count) {
+    flag_object_t* obj = stack_pop(gray);
+    if (obj->kind != ARRAY) {
+      continue;
+    }
+    for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+      flag_object_t* child = obj->data.v_array.elements[i];
+      if (child && !child->is_marked) {
+        child->is_marked = true;
+        stack_push(gray, child);
+      }
+    }
+  }
+  stack_free(gray);
+  t.mark = now_seconds() - start;
+
+  start = now_seconds();
+  for (size_t i = 0; i < objects->count; ++i) {
+    flag_object_t* obj = objects->data[i];
+    if (obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      pool_release(heap, obj);
+      objects->data[i] = NULL;
+    }
+  }
+  stack_remove_nulls(objects);
+  t.sweep = now_seconds() - start;
+
+  if (heap->count != HEAP_OBJECTS / 2 + 1) {
+    printf("flag: wrong survivor count %zu\n", heap->count);
+    exit(1);
+  }
+
+  free(root->data.v_array.elements);
+  stack_free(objects);
+  pool_free(heap);
+  return t;
+}
+
+static timing_t bench_bitmap(void) {
+  pool_t* heap = pool_new(sizeof(bitmap_object_t));
+
+  bitmap_object_t* root = pool_alloc(heap);
+  root->kind = ARRAY;
+  root->data.v_array.size = HEAP_OBJECTS / 2;
+  root->data.v_array.elements = calloc(HEAP_OBJECTS / 2, sizeof(void*));
+  for (size_t i = 0; i < HEAP_OBJECTS; ++i) {
+    bitmap_object_t* obj = pool_alloc(heap);
+    obj->kind = INTEGER;
+    obj->data.v_int = i;
+    if (i % 2 == 0) {
+      root->data.v_array.elements[i / 2] = obj;
+    }
+  }
+
+  timing_t t;
+  double start = now_seconds();
+  pool_mark(root);
+  stack_t* gray = stack_new(8);
+  for (pool_page_t* page = heap->pages; page; page = page->next) {
+    for (size_t w = 0; w < page->words; ++w) {
+      uint64_t marked = page->marks[w];
+      while (marked) {
+        size_t slot = w * POOL_WORD_BITS + __builtin_ctzll(marked);
+        marked &= marked - 1;
+        stack_push(gray, page->objects + slot * heap->object_size);
+      }
+    }
+  }
+  while (gray->count) {
+    bitmap_object_t* obj = stack_pop(gray);
+    if (obj->kind != ARRAY) {
+      continue;
+    }
+    for (size_t i = 0; i < obj->data.v_array.size; ++i) {
+      bitmap_object_t* child = obj->data.v_array.elements[i];
+      if (child && pool_mark(child)) {
+        stack_push(gray, child);
+      }
+    }
+  }
+  stack_free(gray);
+  t.mark = now_seconds() - start;
+
+  start = now_seconds();
+  for (pool_page_t* page = heap->pages; page; page = page->next) {
+    for (size_t w = 0; w < page->words; ++w) {
+      uint64_t dead = page->live[w] & ~page->marks[w];
+      while (dead) {
+        size_t slot = w * POOL_WORD_BITS + __builtin_ctzll(dead);
+        dead &= dead - 1;
+        pool_release(heap, page->objects + slot * heap->object_size);
+      }
+    }
+  }
+  pool_clear_marks(heap);
+  t.sweep = now_seconds() - start;
+
+  if (heap->count != HEAP_OBJECTS / 2 + 1) {
+    printf("bitmap: wrong survivor count %zu\n", heap->count);
+    exit(1);
+  }
+
+  free(root->data.v_array.elements);
+  pool_free(heap);
+  return t;
+}
+
+int main() {
+  timing_t flag = {0};
+  timing_t bitmap = {0};
+
+  for (int i = 0; i < ROUNDS; ++i) {
+    timing_t f = bench_flag();
+    timing_t b = bench_bitmap();
+    flag.mark += f.mark / ROUNDS;
+    flag.sweep += f.sweep / ROUNDS;
+    bitmap.mark += b.mark / ROUNDS;
+    bitmap.sweep += b.sweep / ROUNDS;
+  }
+
+  printf("%d objects, half live, mean of %d rounds\n", HEAP_OBJECTS, ROUNDS);
+  printf("  object size:  flag %zu bytes, bitmap %zu bytes\n",
+         sizeof(flag_object_t), sizeof(bitmap_object_t));
+  printf("  mark+trace:   flag %.2f ms, bitmap %.2f ms\n", flag.mark * 1e3,
+         bitmap.mark * 1e3);
+  printf("  sweep:        flag %.2f ms, bitmap %.2f ms\n", flag.sweep * 1e3,
+         bitmap.sweep * 1e3);
+
+  return 0;
+}
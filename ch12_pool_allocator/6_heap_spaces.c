@@ -0,0 +1,916 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Heap---------------------------------------
+// The heap is a set of spaces, one per size class. A space is a list of
+// page-aligned pages mapped straight from the OS, each with a header holding
+// an allocation bitmap and a mark bitmap, one bit per slot. There is no free
+// list threaded through the slots: allocation looks for a clear bit, so a page
+// whose memory went back to the OS needs no rebuilding, its bitmap already
+// says it is empty.
+#define HEAP_PAGE_SIZE (64 * 1024)
+#define HEAP_WORD_BITS 64
+// Buffer size classes run 16, 32, ... 2048 bytes, anything bigger is malloc'd
+#define HEAP_MIN_CLASS_SIZE 16
+#define HEAP_SIZE_CLASSES 8
+
+typedef struct HeapSpace heap_space_t;
+
+typedef struct HeapPage {
+  struct HeapPage* next;
+  heap_space_t* space;
+  size_t live_count;
+  bool is_released;  // madvise'd away, touching it faults in zeroed memory
+  uint64_t* live;
+  uint64_t* marks;
+  char* objects;
+} heap_page_t;
+
+typedef struct HeapSpace {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t words;  // bitmap words, ceil(objects_per_page / 64)
+  size_t count;  // live slots
+  heap_page_t* pages;
+  heap_page_t* last;
+  heap_page_t* current;  // where the search for a clear bit starts
+} heap_space_t;
+
+typedef struct Heap {
+  heap_space_t objects;  // swept by the collector
+  heap_space_t buffers[HEAP_SIZE_CLASSES];  // freed by the objects owning them
+  size_t page_count;
+  size_t released_pages;  // currently madvise'd away
+} heap_t;
+
+void heap_space_init(heap_space_t* space, size_t object_size) {
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  // Each slot costs its size plus one live and one mark bit
+  size_t room = HEAP_PAGE_SIZE - sizeof(heap_page_t);
+  size_t n = room * 8 / (object_size * 8 + 2);
+  size_t words = (n + HEAP_WORD_BITS - 1) / HEAP_WORD_BITS;
+  while (2 * words * sizeof(uint64_t) + n * object_size > room) {
+    n--;
+    words = (n + HEAP_WORD_BITS - 1) / HEAP_WORD_BITS;
+  }
+
+  *space = (heap_space_t){
+      .object_size = object_size,
+      .objects_per_page = n,
+      .words = words,
+  };
+}
+
+heap_t* heap_new(size_t object_size) {
+  heap_t* heap = malloc(sizeof(heap_t));
+  if (heap == NULL) {
+    return NULL;
+  }
+
+  heap_space_init(&heap->objects, object_size);
+  for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+    heap_space_init(&heap->buffers[i], (size_t)HEAP_MIN_CLASS_SIZE << i);
+  }
+  heap->page_count = 0;
+  heap->released_pages = 0;
+  return heap;
+}
+
+// mmap only promises OS page alignment, so map twice the size and trim the
+// ends until a HEAP_PAGE_SIZE aligned page is left.
+static heap_page_t* heap_page_map(void) {
+  size_t size = 2 * HEAP_PAGE_SIZE;
+  char* raw = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+
+  uintptr_t start = ((uintptr_t)raw + HEAP_PAGE_SIZE - 1) &
+                    ~(uintptr_t)(HEAP_PAGE_SIZE - 1);
+  char* page = (char*)start;
+  if (page > raw) {
+    munmap(raw, page - raw);
+  }
+  if (page + HEAP_PAGE_SIZE < raw + size) {
+    munmap(page + HEAP_PAGE_SIZE, raw + size - (page + HEAP_PAGE_SIZE));
+  }
+  return (heap_page_t*)page;
+}
+
+static heap_page_t* heap_space_grow(heap_t* heap, heap_space_t* space) {
+  heap_page_t* page = heap_page_map();
+  if (page == NULL) {
+    return NULL;
+  }
+
+  // Fresh mappings are zeroed, both bitmaps start out clear
+  page->next = NULL;
+  page->space = space;
+  page->live_count = 0;
+  page->is_released = false;
+  page->live = (uint64_t*)(page + 1);
+  page->marks = page->live + space->words;
+  page->objects = (char*)(page->marks + space->words);
+
+  if (space->last != NULL) {
+    space->last->next = page;
+  } else {
+    space->pages = page;
+  }
+  space->last = page;
+  heap->page_count++;
+  return page;
+}
+
+heap_page_t* heap_page_of(void* obj) {
+  return (heap_page_t*)((uintptr_t)obj & ~(uintptr_t)(HEAP_PAGE_SIZE - 1));
+}
+
+static size_t heap_slot_of(heap_page_t* page, void* obj) {
+  return ((char*)obj - page->objects) / page->space->object_size;
+}
+
+static heap_page_t* heap_space_find_page(heap_space_t* space,
+                                         heap_page_t* from,
+                                         heap_page_t* to) {
+  for (heap_page_t* page = from; page != to; page = page->next) {
+    if (page->live_count < space->objects_per_page) {
+      return page;
+    }
+  }
+  return NULL;
+}
+
+void* heap_space_alloc(heap_t* heap, heap_space_t* space) {
+  // From the current page to the end, then wrap around to the pages before
+  // it, and only then map a new one.
+  heap_page_t* page = heap_space_find_page(space, space->current, NULL);
+  if (page == NULL) {
+    page = heap_space_find_page(space, space->pages, space->current);
+  }
+  if (page == NULL) {
+    page = heap_space_grow(heap, space);
+    if (page == NULL) {
+      return NULL;
+    }
+  }
+  space->current = page;
+
+  // A page with room always has a clear bit below objects_per_page
+  size_t slot = 0;
+  for (size_t w = 0; w < space->words; ++w) {
+    if (~page->live[w]) {
+      slot = w * HEAP_WORD_BITS + __builtin_ctzll(~page->live[w]);
+      break;
+    }
+  }
+  page->live[slot / HEAP_WORD_BITS] |= 1ull << (slot % HEAP_WORD_BITS);
+  page->live_count++;
+  space->count++;
+
+  if (page->is_released) {
+    page->is_released = false;
+    heap->released_pages--;
+  }
+
+  // Same contract as the calloc it replaces
+  void* obj = page->objects + slot * space->object_size;
+  memset(obj, 0, space->object_size);
+  return obj;
+}
+
+void heap_space_release(void* obj) {
+  heap_page_t* page = heap_page_of(obj);
+  size_t slot = heap_slot_of(page, obj);
+  page->live[slot / HEAP_WORD_BITS] &= ~(1ull << (slot % HEAP_WORD_BITS));
+  page->live_count--;
+  page->space->count--;
+}
+
+// Smallest class that fits, or -1 when the buffer is too big for the heap
+int heap_size_class(size_t size) {
+  for (int i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+    if (size <= (size_t)HEAP_MIN_CLASS_SIZE << i) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void* heap_alloc_buffer(heap_t* heap, size_t size) {
+  int class = heap_size_class(size);
+  if (class < 0) {
+    return calloc(1, size);
+  }
+  return heap_space_alloc(heap, &heap->buffers[class]);
+}
+
+// The owner knows the size it asked for, which tells where the buffer lives
+void heap_free_buffer(void* buffer, size_t size) {
+  if (heap_size_class(size) < 0) {
+    free(buffer);
+    return;
+  }
+  heap_space_release(buffer);
+}
+
+bool heap_is_marked(void* obj) {
+  heap_page_t* page = heap_page_of(obj);
+  size_t slot = heap_slot_of(page, obj);
+  return page->marks[slot / HEAP_WORD_BITS] & (1ull << (slot % HEAP_WORD_BITS));
+}
+
+// Sets the mark bit, returns false if it was already set
+bool heap_mark(void* obj) {
+  heap_page_t* page = heap_page_of(obj);
+  size_t slot = heap_slot_of(page, obj);
+  uint64_t bit = 1ull << (slot % HEAP_WORD_BITS);
+  uint64_t* word = &page->marks[slot / HEAP_WORD_BITS];
+  if (*word & bit) {
+    return false;
+  }
+
+  *word |= bit;
+  return true;
+}
+
+// Hands the slots of an empty page back to the OS. The header shares its OS
+// page with the first slots, so only whole OS pages after it are dropped.
+static void heap_page_release(heap_t* heap, heap_page_t* page) {
+  uintptr_t os_page = sysconf(_SC_PAGESIZE);
+  uintptr_t start =
+      ((uintptr_t)page->objects + os_page - 1) & ~(os_page - 1);
+  uintptr_t end = (uintptr_t)page + HEAP_PAGE_SIZE;
+  madvise((void*)start, end - start, MADV_DONTNEED);
+
+  page->is_released = true;
+  heap->released_pages++;
+}
+
+static void heap_space_release_empty(heap_t* heap, heap_space_t* space) {
+  for (heap_page_t* page = space->pages; page; page = page->next) {
+    if (page->live_count == 0 && !page->is_released) {
+      heap_page_release(heap, page);
+    }
+  }
+}
+
+void heap_release_empty_pages(heap_t* heap) {
+  heap_space_release_empty(heap, &heap->objects);
+  for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+    heap_space_release_empty(heap, &heap->buffers[i]);
+  }
+}
+
+static void heap_space_free(heap_space_t* space) {
+  heap_page_t* page = space->pages;
+  while (page != NULL) {
+    heap_page_t* next = page->next;
+    munmap(page, HEAP_PAGE_SIZE);
+    page = next;
+  }
+}
+
+void heap_free(heap_t* heap) {
+  if (heap == NULL) {
+    return;
+  }
+
+  heap_space_free(&heap->objects);
+  for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+    heap_space_free(&heap->buffers[i]);
+  }
+  free(heap);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+// No mark flag here, marks live in the heap pages' bitmaps
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      heap_free_buffer(obj->data.v_string, strlen(obj->data.v_string) + 1);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      heap_free_buffer(obj->data.v_array.elements,
+                       obj->data.v_array.size * sizeof(snek_object_t*));
+      break;
+    }
+  }
+  heap_space_release(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// The heap's live bitmaps already know every object, so there is no
+// separate objects stack to keep in sync.
+typedef struct VirtualMachine {
+  stack_t* frames;
+  heap_t* heap;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->heap = heap_new(sizeof(snek_object_t));
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  heap_free(vm->heap);
+  free(vm);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      heap_mark(obj);
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  // The roots are whatever mark() set, found a word at a time
+  heap_space_t* space = &vm->heap->objects;
+  size_t object_size = space->object_size;
+  for (heap_page_t* page = space->pages; page; page = page->next) {
+    for (size_t w = 0; w < space->words; ++w) {
+      uint64_t marked = page->marks[w];
+      while (marked) {
+        size_t slot = w * HEAP_WORD_BITS + __builtin_ctzll(marked);
+        marked &= marked - 1;
+        stack_push(gray_objects, page->objects + slot * object_size);
+      }
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || !heap_mark(obj)) {
+    return;
+  }
+
+  stack_push(gray_objects, obj);
+}
+
+// Walks the object pages, a word of slots at a time. Pages left empty
+// afterwards, in any space, go back to the OS.
+void sweep(vm_t* vm) {
+  heap_space_t* space = &vm->heap->objects;
+  for (heap_page_t* page = space->pages; page; page = page->next) {
+    if (page->live_count == 0) {
+      continue;
+    }
+
+    for (size_t w = 0; w < space->words; ++w) {
+      uint64_t dead = page->live[w] & ~page->marks[w];
+      while (dead) {
+        size_t slot = w * HEAP_WORD_BITS + __builtin_ctzll(dead);
+        dead &= dead - 1;
+        snek_object_free((snek_object_t*)(page->objects +
+                                          slot * space->object_size));
+      }
+    }
+    memset(page->marks, 0, space->words * sizeof(uint64_t));
+  }
+
+  heap_release_empty_pages(vm->heap);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = heap_space_alloc(vm->heap, &vm->heap->objects);
+  if (obj == NULL) {
+    return NULL;
+  }
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements =
+      heap_alloc_buffer(vm->heap, size * sizeof(snek_object_t*));
+  if (elements == NULL) {
+    // Already live in the heap, the next sweep hands it back
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = heap_alloc_buffer(vm->heap, len + 1);
+  if (dst == NULL) {
+    // Already live in the heap, the next sweep hands it back
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+// Counts the OS pages of [start, end) that are backed by memory right now
+static size_t resident_os_pages(void* start, void* end) {
+  size_t os_page = sysconf(_SC_PAGESIZE);
+  size_t count = ((char*)end - (char*)start) / os_page;
+  unsigned char residency[HEAP_PAGE_SIZE / 4096];
+  if (count > sizeof(residency) || mincore(start, count * os_page, residency)) {
+    return (size_t)-1;
+  }
+
+  size_t resident = 0;
+  for (size_t i = 0; i < count; ++i) {
+    resident += residency[i] & 1;
+  }
+  return resident;
+}
+
+static MunitResult test_simple(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "I wish I knew how to read.");
+  frame_reference_object(f1, s);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, 1);
+  munit_assert_false(heap_is_marked(s));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, 0);
+  munit_assert_int(vm->heap->buffers[1].count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_size_classes(const MunitParameter params[],
+                                     void* data) {
+  vm_t* vm = vm_new();
+  boot_stats_t before = boot_stats();
+
+  // 5 bytes, 27 bytes and a 1000 byte element buffer
+  snek_object_t* small = new_snek_string(vm, "snek");
+  snek_object_t* medium = new_snek_string(vm, "I wish I knew how to read.");
+  snek_object_t* arr = new_snek_array(vm, 125);
+
+  munit_assert_ptr_equal(heap_page_of(small)->space, &vm->heap->objects);
+  munit_assert_ptr_equal(heap_page_of(small->data.v_string)->space,
+                         &vm->heap->buffers[0]);
+  munit_assert_ptr_equal(heap_page_of(medium->data.v_string)->space,
+                         &vm->heap->buffers[1]);
+  munit_assert_ptr_equal(heap_page_of(arr->data.v_array.elements)->space,
+                         &vm->heap->buffers[6]);
+  munit_assert_int(boot_stats().alloc_count - before.alloc_count, ==, 0);
+
+  // Past the biggest class it is an ordinary malloc
+  char big[4096];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  new_snek_string(vm, big);
+  munit_assert_int(boot_stats().alloc_count - before.alloc_count, ==, 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, 0);
+  for (size_t i = 0; i < HEAP_SIZE_CLASSES; ++i) {
+    munit_assert_int(vm->heap->buffers[i].count, ==, 0);
+  }
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_bitmap_reuses_slots(const MunitParameter params[],
+                                            void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead = new_snek_integer(vm, 1);
+  snek_object_t* live = new_snek_integer(vm, 2);
+  frame_reference_object(f1, live);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, 1);
+
+  // The first clear bit is the swept slot, handed out zeroed
+  snek_object_t* reused = new_snek_float(vm, 4.2);
+  munit_assert_ptr_equal(reused, dead);
+  munit_assert_int(live->data.v_int, ==, 2);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_trace_array(const MunitParameter params[],
+                                    void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Enough objects to span several bitmap words and pages
+  size_t n = vm->heap->objects.objects_per_page * 2 + 3;
+  snek_object_t* array = new_snek_array(vm, n);
+  frame_reference_object(f1, array);
+  for (size_t i = 0; i < n; ++i) {
+    snek_array_set(array, i, new_snek_integer(vm, i));
+    new_snek_integer(vm, -1);  // garbage between each live one
+  }
+  munit_assert_int(vm->heap->objects.count, ==, 2 * n + 1);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, n + 1);
+  for (size_t i = 0; i < n; ++i) {
+    munit_assert_int(snek_array_get(array, i)->data.v_int, ==, i);
+  }
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->objects.count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_empty_pages_released(const MunitParameter params[],
+                                             void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  size_t n = vm->heap->objects.objects_per_page * 3;
+  for (size_t i = 0; i < n; ++i) {
+    new_snek_integer(vm, i);
+  }
+  frame_reference_object(f1, new_snek_integer(vm, 42));
+  munit_assert_int(vm->heap->page_count, ==, 4);
+
+  heap_page_t* first = vm->heap->objects.pages;
+  size_t os_page = sysconf(_SC_PAGESIZE);
+  char* tail = (char*)first + os_page;
+  char* end = (char*)first + HEAP_PAGE_SIZE;
+  munit_assert_int(resident_os_pages(tail, end), >, 0);
+
+  // The three full pages died, the survivor keeps the fourth
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->released_pages, ==, 3);
+  munit_assert_true(first->is_released);
+  munit_assert_int(resident_os_pages(tail, end), ==, 0);
+
+  // Released pages are reused before anything new is mapped
+  for (size_t i = 0; i < n; ++i) {
+    new_snek_integer(vm, i);
+  }
+  munit_assert_int(vm->heap->page_count, ==, 4);
+  munit_assert_int(vm->heap->released_pages, ==, 0);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->released_pages, ==, 4);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_size_classes", test_size_classes, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_bitmap_reuses_slots", test_bitmap_reuses_slots, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_trace_array", test_trace_array, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_empty_pages_released", test_empty_pages_released, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "heap-spaces",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,766 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+  snek_object_t* v_forward;  // a promoted nursery object points to its copy
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+  bool is_old;         // lives in the old space, not the nursery
+  bool is_remembered;  // old object already in the remembered set
+  bool is_forwarded;   // nursery object that was promoted
+} snek_object_t;
+
+// Frees what the object owns, not the object itself
+void snek_object_free_data(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+}
+
+void snek_object_free(snek_object_t* obj) {
+  snek_object_free_data(obj);
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// Objects are born in a bump-allocated nursery. A minor collection copies
+// the survivors into the old space and resets the nursery, the old space is
+// only traced by a full vm_collect_garbage.
+#define NURSERY_OBJECTS 4096
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;  // old space
+  snek_object_t* nursery;
+  size_t nursery_top;
+  size_t nursery_capacity;
+  // Old objects that may point into the nursery, kept by the write barrier
+  stack_t* remembered;
+  // Young strings and arrays, their buffers die with them
+  stack_t* young_buffers;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->nursery = calloc(NURSERY_OBJECTS, sizeof(snek_object_t));
+  vm->nursery_top = 0;
+  vm->nursery_capacity = NURSERY_OBJECTS;
+  vm->remembered = stack_new(8);
+  vm->young_buffers = stack_new(8);
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm->nursery);
+  stack_free(vm->remembered);
+  stack_free(vm->young_buffers);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+bool snek_is_young(snek_object_t* obj) {
+  return obj != NULL && !obj->is_old;
+}
+
+// Called whenever an old object is made to point at value
+void vm_write_barrier(vm_t* vm, snek_object_t* obj, snek_object_t* value) {
+  if (!obj->is_old || obj->is_remembered || !snek_is_young(value)) {
+    return;
+  }
+
+  obj->is_remembered = true;
+  stack_push(vm->remembered, obj);
+}
+//-----------------------------------------------------------------------------
+//------------------------------Minor collection-------------------------------
+snek_object_t* minor_promote(vm_t* vm, stack_t* gray_objects,
+                             snek_object_t* obj) {
+  if (!snek_is_young(obj)) {
+    return obj;
+  }
+  if (obj->is_forwarded) {
+    return obj->data.v_forward;
+  }
+
+  snek_object_t* copy = malloc(sizeof(snek_object_t));
+  if (copy == NULL) {
+    // Unable to promote, just exit :) get gud
+    exit(1);
+  }
+
+  *copy = *obj;
+  copy->is_old = true;
+  vm_track_object(vm, copy);
+
+  obj->is_forwarded = true;
+  obj->data.v_forward = copy;
+
+  // Its fields may still point into the nursery
+  stack_push(gray_objects, copy);
+  return copy;
+}
+
+void minor_scan_object(vm_t* vm, stack_t* gray_objects, snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3: {
+      snek_vector_t* vec = &obj->data.v_vector3;
+      vec->x = minor_promote(vm, gray_objects, vec->x);
+      vec->y = minor_promote(vm, gray_objects, vec->y);
+      vec->z = minor_promote(vm, gray_objects, vec->z);
+      return;
+    }
+    case ARRAY: {
+      snek_array_t* arr = &obj->data.v_array;
+      for (size_t i = 0; i < arr->size; ++i) {
+        arr->elements[i] = minor_promote(vm, gray_objects, arr->elements[i]);
+      }
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+// Cost is roots + remembered set + survivors, old objects are never visited
+// unless the write barrier remembered them.
+void vm_minor_collect(vm_t* vm) {
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      frame->references->data[j] =
+          minor_promote(vm, gray_objects, frame->references->data[j]);
+    }
+  }
+
+  for (size_t i = 0; i < vm->remembered->count; ++i) {
+    snek_object_t* obj = vm->remembered->data[i];
+    obj->is_remembered = false;
+    minor_scan_object(vm, gray_objects, obj);
+  }
+  vm->remembered->count = 0;
+
+  while (gray_objects->count) {
+    minor_scan_object(vm, gray_objects, stack_pop(gray_objects));
+  }
+  stack_free(gray_objects);
+
+  // Whatever was not copied out is dead, only its buffers need freeing
+  for (size_t i = 0; i < vm->young_buffers->count; ++i) {
+    snek_object_t* obj = vm->young_buffers->data[i];
+    if (!obj->is_forwarded) {
+      snek_object_free_data(obj);
+    }
+  }
+  vm->young_buffers->count = 0;
+
+  vm->nursery_top = 0;
+}
+//-----------------------------------------------------------------------------
+//------------------------------Major collection-------------------------------
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  // Empty the nursery first, then everything live is in the old space
+  vm_minor_collect(vm);
+
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  if (vm->nursery_top < vm->nursery_capacity) {
+    snek_object_t* obj = &vm->nursery[vm->nursery_top++];
+    memset(obj, 0, sizeof(snek_object_t));
+    return obj;
+  }
+
+  // Nursery is full, we never collect behind the caller's back (its
+  // arguments are not rooted), so allocate straight into the old space.
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  obj->is_old = true;
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    // Already owned by the vm, an INTEGER until the next collection
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+  if (!obj->is_old) {
+    stack_push(vm->young_buffers, obj);
+  }
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  // Only matters when the nursery was full and obj was born old
+  vm_write_barrier(vm, obj, x);
+  vm_write_barrier(vm, obj, y);
+  vm_write_barrier(vm, obj, z);
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    // Already owned by the vm, an INTEGER until the next collection
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  if (!obj->is_old) {
+    stack_push(vm->young_buffers, obj);
+  }
+  return obj;
+}
+
+bool snek_array_set(vm_t* vm, snek_object_t* array, size_t index,
+                    snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // An old array pointing into the nursery is a root for minor collections
+  vm_write_barrier(vm, array, value);
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_minor_promotes(const MunitParameter params[],
+                                       void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  frame_reference_object(f1, new_snek_integer(vm, 42));
+  for (int i = 0; i < 100; ++i) {
+    new_snek_integer(vm, i);
+  }
+  munit_assert_int(vm->nursery_top, ==, 101);
+  munit_assert_int(vm->objects->count, ==, 0);
+
+  vm_minor_collect(vm);
+
+  // Only the survivor was copied, the nursery starts over
+  munit_assert_int(vm->nursery_top, ==, 0);
+  munit_assert_int(vm->objects->count, ==, 1);
+  snek_object_t* survivor = f1->references->data[0];
+  munit_assert_true(survivor->is_old);
+  munit_assert_int(survivor->data.v_int, ==, 42);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_minor_frees_young_buffers(
+    const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead = new_snek_string(vm, "nobody loves me");
+  char* dead_buffer = dead->data.v_string;
+  frame_reference_object(f1, new_snek_string(vm, "survivor"));
+
+  vm_minor_collect(vm);
+  munit_assert_true(boot_is_freed(dead_buffer));
+
+  snek_object_t* s = f1->references->data[0];
+  munit_assert_string_equal(s->data.v_string, "survivor");
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(s));
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_nested_survivors(const MunitParameter params[],
+                                         void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* array = new_snek_array(vm, 2);
+  snek_array_set(vm, array, 0,
+                 new_snek_vector3(vm, new_snek_integer(vm, 1),
+                                  new_snek_integer(vm, 2),
+                                  new_snek_integer(vm, 3)));
+  snek_array_set(vm, array, 1, new_snek_string(vm, "snek"));
+  frame_reference_object(f1, array);
+
+  vm_minor_collect(vm);
+  munit_assert_int(vm->objects->count, ==, 6);
+
+  array = f1->references->data[0];
+  snek_object_t* vec = snek_array_get(array, 0);
+  munit_assert_true(vec->is_old);
+  munit_assert_true(vec->data.v_vector3.z->is_old);
+  munit_assert_int(vec->data.v_vector3.z->data.v_int, ==, 3);
+  munit_assert_string_equal(snek_array_get(array, 1)->data.v_string, "snek");
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_array_set_barrier(const MunitParameter params[],
+                                          void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  frame_reference_object(f1, new_snek_array(vm, 1));
+  vm_minor_collect(vm);
+  snek_object_t* array = f1->references->data[0];
+  munit_assert_true(array->is_old);
+
+  // Only the old array points at this integer, the barrier must catch it
+  snek_array_set(vm, array, 0, new_snek_integer(vm, 7));
+  munit_assert_int(vm->remembered->count, ==, 1);
+  munit_assert_true(array->is_remembered);
+
+  vm_minor_collect(vm);
+  munit_assert_int(vm->remembered->count, ==, 0);
+  snek_object_t* value = snek_array_get(array, 0);
+  munit_assert_true(value->is_old);
+  munit_assert_int(value->data.v_int, ==, 7);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->objects->count, ==, 0);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector3_born_old(const MunitParameter params[],
+                                         void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* x = new_snek_integer(vm, 1);
+  snek_object_t* y = new_snek_integer(vm, 2);
+  snek_object_t* z = new_snek_integer(vm, 3);
+  while (vm->nursery_top < vm->nursery_capacity) {
+    new_snek_integer(vm, 0);
+  }
+
+  // No room left, the vector goes to the old space with young fields
+  snek_object_t* vec = new_snek_vector3(vm, x, y, z);
+  frame_reference_object(f1, vec);
+  munit_assert_true(vec->is_old);
+  munit_assert_true(vec->is_remembered);
+
+  vm_minor_collect(vm);
+  munit_assert_int(vm->objects->count, ==, 4);
+  munit_assert_true(vec->data.v_vector3.x->is_old);
+  munit_assert_int(vec->data.v_vector3.y->data.v_int, ==, 2);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_minor_promotes", test_minor_promotes, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_minor_frees_young_buffers", test_minor_frees_young_buffers, NULL,
+       NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_nested_survivors", test_nested_survivors, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_array_set_barrier", test_array_set_barrier, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_vector3_born_old", test_vector3_born_old, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "generational",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
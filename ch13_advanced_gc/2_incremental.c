@@ -0,0 +1,709 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// A collection is split into bounded steps. White objects are unmarked,
+// gray ones are marked and still on vm->gray_objects, black ones are marked
+// and fully scanned. Between steps the mutator may run, the write barrier in
+// snek_array_set and new_snek_vector3 keeps any black object from pointing at
+// a white one.
+typedef enum GcPhase {
+  GC_IDLE,
+  GC_MARK,
+  GC_SWEEP,
+} gc_phase_t;
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  gc_phase_t gc_phase;
+  stack_t* gray_objects;
+  // Objects in [sweep_cursor, sweep_end) still have to be swept, survivors
+  // are compacted down to sweep_kept as we go.
+  size_t sweep_cursor;
+  size_t sweep_end;
+  size_t sweep_kept;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->gc_phase = GC_IDLE;
+  vm->gray_objects = stack_new(8);
+  vm->sweep_cursor = 0;
+  vm->sweep_end = 0;
+  vm->sweep_kept = 0;
+  return vm;
+}
+
+bool vm_gc_step(vm_t* vm, size_t budget);
+
+void vm_free(vm_t* vm) {
+  // Let a cycle in flight free what it already found dead
+  if (vm->gc_phase != GC_IDLE) {
+    vm_gc_step(vm, SIZE_MAX);
+  }
+
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  stack_free(vm->gray_objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+// Shades every frame reference gray, returns the work done
+size_t mark(vm_t* vm) {
+  size_t work = 0;
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      trace_mark_object(vm->gray_objects, frame->references->data[j]);
+    }
+    work += frame->references->count;
+  }
+  return work;
+}
+
+// Scans one gray object, returns the work done: one unit for the object
+// plus one per reference it holds.
+size_t trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return 0;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return 1;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return 4;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return 1 + arr.size;
+    default:
+      return 1;
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+// Dijkstra barrier: shade the new value while marking, so a black object
+// never ends up pointing at a white one.
+void vm_write_barrier(vm_t* vm, snek_object_t* value) {
+  if (vm->gc_phase == GC_MARK) {
+    trace_mark_object(vm->gray_objects, value);
+  }
+}
+
+static void sweep_begin(vm_t* vm) {
+  vm->sweep_cursor = 0;
+  vm->sweep_kept = 0;
+  vm->sweep_end = vm->objects->count;
+  vm->gc_phase = GC_SWEEP;
+}
+
+static void sweep_end(vm_t* vm) {
+  stack_t* objects = vm->objects;
+
+  // Objects allocated while sweeping sit past sweep_end, slide them down
+  size_t fresh = objects->count - vm->sweep_end;
+  memmove(&objects->data[vm->sweep_kept], &objects->data[vm->sweep_end],
+          fresh * sizeof(void*));
+  objects->count = vm->sweep_kept + fresh;
+
+  vm->sweep_cursor = 0;
+  vm->sweep_end = 0;
+  vm->sweep_kept = 0;
+  vm->gc_phase = GC_IDLE;
+}
+
+// Does at most about budget units of collection work. A single object is
+// never split, so an ARRAY can overshoot by its length, and the frames are
+// shaded in one go. Starts a new cycle when idle, returns true once the
+// cycle is complete.
+bool vm_gc_step(vm_t* vm, size_t budget) {
+  size_t work = 0;
+
+  if (vm->gc_phase == GC_IDLE) {
+    work += mark(vm);
+    vm->gc_phase = GC_MARK;
+  }
+
+  while (vm->gc_phase == GC_MARK && work < budget) {
+    if (vm->gray_objects->count == 0) {
+      // Frames are not behind the write barrier, so shade them again
+      // before declaring the mark finished.
+      work += mark(vm);
+      if (vm->gray_objects->count == 0) {
+        sweep_begin(vm);
+      }
+      continue;
+    }
+
+    snek_object_t* obj = stack_pop(vm->gray_objects);
+    work += trace_blacken_object(vm->gray_objects, obj);
+  }
+
+  while (vm->gc_phase == GC_SWEEP && work < budget) {
+    if (vm->sweep_cursor == vm->sweep_end) {
+      sweep_end(vm);
+      break;
+    }
+
+    snek_object_t* obj = vm->objects->data[vm->sweep_cursor++];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+      vm->objects->data[vm->sweep_kept++] = obj;
+    } else {
+      snek_object_free(obj);
+    }
+    work++;
+  }
+
+  return vm->gc_phase == GC_IDLE;
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  // Finish a cycle in flight, then run a full one from fresh roots
+  if (vm->gc_phase != GC_IDLE) {
+    vm_gc_step(vm, SIZE_MAX);
+  }
+  vm_gc_step(vm, SIZE_MAX);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  // Allocate black while marking, nothing scanned yet can point to it but
+  // the marker would never come back for it either.
+  obj->is_marked = vm->gc_phase == GC_MARK;
+
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  // The vector is born black while marking, its components need the same
+  // barrier as any other store.
+  vm_write_barrier(vm, x);
+  vm_write_barrier(vm, y);
+  vm_write_barrier(vm, z);
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(vm_t* vm, snek_object_t* array, size_t index,
+                    snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  vm_write_barrier(vm, value);
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_step_is_bounded(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  for (int i = 0; i < 100; ++i) {
+    frame_reference_object(f1, new_snek_integer(vm, i));
+    new_snek_integer(vm, -i);
+  }
+
+  int steps = 1;
+  munit_assert_false(vm_gc_step(vm, 10));
+  munit_assert_int(vm->gc_phase, ==, GC_MARK);
+  while (!vm_gc_step(vm, 10)) {
+    steps++;
+  }
+
+  // 100 objects to blacken and 200 to sweep, 10 at a time. The two root
+  // scans are done in one go each.
+  munit_assert_int(steps, >=, 30);
+  munit_assert_int(vm->gc_phase, ==, GC_IDLE);
+  munit_assert_int(vm->objects->count, ==, 100);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_write_barrier(const MunitParameter params[],
+                                      void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* array = new_snek_array(vm, 1);
+  frame_reference_object(f1, array);
+  // Only held in a C local, white when the cycle starts
+  snek_object_t* value = new_snek_integer(vm, 7);
+
+  vm_gc_step(vm, 1);  // shade the roots
+  vm_gc_step(vm, 2);  // blacken the array
+  munit_assert_int(vm->gray_objects->count, ==, 0);
+  munit_assert_int(vm->gc_phase, ==, GC_MARK);
+
+  // Black array now points at a white object, the barrier shades it
+  snek_array_set(vm, array, 0, value);
+  munit_assert_true(value->is_marked);
+
+  while (!vm_gc_step(vm, 2)) {
+  }
+  munit_assert_false(boot_is_freed(value));
+  munit_assert_ptr_equal(snek_array_get(array, 0), value);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(value));
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_allocate_black(const MunitParameter params[],
+                                       void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+  frame_reference_object(f1, new_snek_integer(vm, 1));
+
+  vm_gc_step(vm, 1);
+  snek_object_t* fresh = new_snek_string(vm, "born during marking");
+  munit_assert_true(fresh->is_marked);
+  while (!vm_gc_step(vm, 1)) {
+  }
+
+  munit_assert_false(boot_is_freed(fresh));
+  munit_assert_false(fresh->is_marked);
+  munit_assert_int(vm->objects->count, ==, 2);
+
+  // Unreferenced, so the next cycle takes it
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(fresh));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_vector_built_while_marking(
+    const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+  frame_reference_object(f1, new_snek_integer(vm, 1));
+
+  // Only held in C locals, white when the cycle starts
+  snek_object_t* x = new_snek_integer(vm, 1);
+  snek_object_t* y = new_snek_integer(vm, 2);
+  snek_object_t* z = new_snek_integer(vm, 3);
+
+  vm_gc_step(vm, 1);
+  munit_assert_int(vm->gc_phase, ==, GC_MARK);
+
+  // Born black, so the marker never scans it, its components get shaded
+  snek_object_t* v = new_snek_vector3(vm, x, y, z);
+  munit_assert_true(v->is_marked);
+  munit_assert_true(x->is_marked);
+  munit_assert_true(y->is_marked);
+  munit_assert_true(z->is_marked);
+  frame_reference_object(f1, v);
+
+  while (!vm_gc_step(vm, 1)) {
+  }
+  munit_assert_false(boot_is_freed(x));
+  munit_assert_false(boot_is_freed(y));
+  munit_assert_false(boot_is_freed(z));
+  munit_assert_int(vm->objects->count, ==, 5);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_full(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+  frame_t* f2 = vm_new_frame(vm);
+  frame_t* f3 = vm_new_frame(vm);
+
+  snek_object_t* s1 = new_snek_string(vm, "This string is going into frame 1");
+  frame_reference_object(f1, s1);
+
+  snek_object_t* s2 = new_snek_string(vm, "This string is going into frame 2");
+  frame_reference_object(f2, s2);
+
+  snek_object_t* s3 = new_snek_string(vm, "This string is going into frame 3");
+  frame_reference_object(f3, s3);
+
+  snek_object_t* i1 = new_snek_integer(vm, 69);
+  snek_object_t* i2 = new_snek_integer(vm, 420);
+  snek_object_t* i3 = new_snek_integer(vm, 1337);
+  snek_object_t* v = new_snek_vector3(vm, i1, i2, i3);
+
+  frame_reference_object(f2, v);
+  frame_reference_object(f3, v);
+
+  munit_assert_int(vm->objects->count, ==, 7);
+
+  // only free the top frame (f3)
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_false(boot_is_freed(s1));
+  munit_assert_false(boot_is_freed(s2));
+
+  frame_free(vm_frame_pop(vm));
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  munit_assert_true(boot_is_freed(s1));
+  munit_assert_true(boot_is_freed(s2));
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_true(boot_is_freed(v));
+  munit_assert_true(boot_is_freed(i1));
+  munit_assert_true(boot_is_freed(i2));
+  munit_assert_true(boot_is_freed(i3));
+  munit_assert_int(vm->objects->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_step_is_bounded", test_step_is_bounded, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_write_barrier", test_write_barrier, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_allocate_black", test_allocate_black, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_vector_built_while_marking", test_vector_built_while_marking,
+       NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_full", test_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "incremental",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,769 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  atomic_bool is_marked;  // set concurrently by the mark workers
+} snek_object_t;
+
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  size_t mark_threads;  // 1 marks on the calling thread only
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->mark_threads = 1;
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      atomic_store_explicit(&obj->is_marked, true, memory_order_relaxed);
+    }
+  }
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Mark deque----------------------------------
+// Every mark worker owns a deque of gray work. The owner pushes and pops at
+// the bottom, idle workers steal from the top. Arrays are scanned in chunks
+// of MARK_CHUNK elements so one huge array still spreads over all workers.
+#define MARK_CHUNK 1024
+
+typedef struct MarkTask {
+  snek_object_t* obj;
+  size_t start;  // first array element still to scan
+} mark_task_t;
+
+typedef struct MarkDeque {
+  pthread_mutex_t lock;
+  size_t top;
+  size_t bottom;
+  size_t capacity;
+  mark_task_t* tasks;
+} mark_deque_t;
+
+bool mark_deque_init(mark_deque_t* deque) {
+  deque->top = 0;
+  deque->bottom = 0;
+  deque->capacity = 64;
+  deque->tasks = malloc(deque->capacity * sizeof(mark_task_t));
+  if (deque->tasks == NULL) {
+    return false;
+  }
+
+  pthread_mutex_init(&deque->lock, NULL);
+  return true;
+}
+
+void mark_deque_free(mark_deque_t* deque) {
+  pthread_mutex_destroy(&deque->lock);
+  free(deque->tasks);
+}
+
+void mark_deque_push(mark_deque_t* deque, mark_task_t* tasks, size_t count) {
+  pthread_mutex_lock(&deque->lock);
+
+  if (deque->bottom + count > deque->capacity) {
+    // Reclaim what thieves already took before growing
+    size_t live = deque->bottom - deque->top;
+    memmove(deque->tasks, &deque->tasks[deque->top],
+            live * sizeof(mark_task_t));
+    deque->top = 0;
+    deque->bottom = live;
+
+    while (deque->bottom + count > deque->capacity) {
+      deque->capacity *= 2;
+    }
+    deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(mark_task_t));
+    if (deque->tasks == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  memcpy(&deque->tasks[deque->bottom], tasks, count * sizeof(mark_task_t));
+  deque->bottom += count;
+
+  pthread_mutex_unlock(&deque->lock);
+}
+
+bool mark_deque_pop(mark_deque_t* deque, mark_task_t* task) {
+  pthread_mutex_lock(&deque->lock);
+
+  bool found = deque->top < deque->bottom;
+  if (found) {
+    *task = deque->tasks[--deque->bottom];
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+bool mark_deque_steal(mark_deque_t* deque, mark_task_t* task) {
+  pthread_mutex_lock(&deque->lock);
+
+  bool found = deque->top < deque->bottom;
+  if (found) {
+    *task = deque->tasks[deque->top++];
+  }
+
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Parallel trace------------------------------
+typedef struct MarkContext {
+  size_t threads;
+  mark_deque_t* deques;
+  // Tasks pushed but not finished, the trace is over when it drops to 0
+  atomic_size_t pending;
+} mark_context_t;
+
+typedef struct MarkWorker {
+  mark_context_t* ctx;
+  size_t id;
+} mark_worker_t;
+
+// Only the worker that flips the bit gets to scan the object
+bool trace_try_mark(snek_object_t* obj) {
+  if (obj == NULL) {
+    return false;
+  }
+  if (atomic_load_explicit(&obj->is_marked, memory_order_relaxed)) {
+    return false;
+  }
+  return !atomic_exchange_explicit(&obj->is_marked, true,
+                                   memory_order_relaxed);
+}
+
+void trace_blacken_task(mark_context_t* ctx, mark_deque_t* own,
+                        mark_task_t task) {
+  mark_task_t found[MARK_CHUNK + 1];
+  size_t count = 0;
+  snek_object_t* obj = task.obj;
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3: {
+      snek_object_t* fields[] = {obj->data.v_vector3.x, obj->data.v_vector3.y,
+                                 obj->data.v_vector3.z};
+      for (size_t i = 0; i < 3; ++i) {
+        if (trace_try_mark(fields[i])) {
+          found[count++] = (mark_task_t){.obj = fields[i], .start = 0};
+        }
+      }
+      break;
+    }
+    case ARRAY: {
+      snek_array_t arr = obj->data.v_array;
+      size_t end = task.start + MARK_CHUNK;
+      if (end < arr.size) {
+        // Leave the rest of the array where someone can steal it
+        found[count++] = (mark_task_t){.obj = obj, .start = end};
+      } else {
+        end = arr.size;
+      }
+
+      for (size_t i = task.start; i < end; ++i) {
+        if (trace_try_mark(arr.elements[i])) {
+          found[count++] = (mark_task_t){.obj = arr.elements[i], .start = 0};
+        }
+      }
+      break;
+    }
+    default:
+      return;
+  }
+
+  if (count > 0) {
+    // Count the new tasks before anyone can steal and finish them
+    atomic_fetch_add(&ctx->pending, count);
+    mark_deque_push(own, found, count);
+  }
+}
+
+void* trace_worker_run(void* arg) {
+  mark_worker_t* worker = arg;
+  mark_context_t* ctx = worker->ctx;
+  mark_deque_t* own = &ctx->deques[worker->id];
+
+  while (true) {
+    mark_task_t task;
+    bool found = mark_deque_pop(own, &task);
+    for (size_t i = 1; !found && i < ctx->threads; ++i) {
+      found = mark_deque_steal(&ctx->deques[(worker->id + i) % ctx->threads],
+                               &task);
+    }
+
+    if (found) {
+      trace_blacken_task(ctx, own, task);
+      atomic_fetch_sub(&ctx->pending, 1);
+      continue;
+    }
+
+    if (atomic_load(&ctx->pending) == 0) {
+      return NULL;
+    }
+    sched_yield();
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  size_t threads = vm->mark_threads ? vm->mark_threads : 1;
+  mark_context_t ctx = {.threads = threads};
+  ctx.deques = malloc(threads * sizeof(mark_deque_t));
+  mark_worker_t* workers = malloc(threads * sizeof(mark_worker_t));
+  pthread_t* handles = malloc(threads * sizeof(pthread_t));
+  if (!ctx.deques || !workers || !handles) {
+    // Unable to start the trace, just exit :) get gud
+    exit(1);
+  }
+
+  for (size_t i = 0; i < threads; ++i) {
+    if (!mark_deque_init(&ctx.deques[i])) {
+      exit(1);
+    }
+    workers[i] = (mark_worker_t){.ctx = &ctx, .id = i};
+  }
+
+  // Deal the roots out round-robin
+  size_t roots = 0;
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && atomic_load_explicit(&obj->is_marked, memory_order_relaxed)) {
+      mark_task_t task = {.obj = obj, .start = 0};
+      mark_deque_push(&ctx.deques[roots++ % threads], &task, 1);
+    }
+  }
+  atomic_init(&ctx.pending, roots);
+
+  // The calling thread is worker 0. A worker that fails to start just leaves
+  // its deque to be stolen from, down to marking inline on this thread.
+  size_t started = 1;
+  for (size_t i = 1; i < threads; ++i) {
+    if (pthread_create(&handles[started], NULL, trace_worker_run,
+                       &workers[i]) == 0) {
+      started++;
+    }
+  }
+  trace_worker_run(&workers[0]);
+  for (size_t i = 1; i < started; ++i) {
+    pthread_join(handles[i], NULL);
+  }
+
+  for (size_t i = 0; i < threads; ++i) {
+    mark_deque_free(&ctx.deques[i]);
+  }
+  free(ctx.deques);
+  free(workers);
+  free(handles);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && atomic_load_explicit(&obj->is_marked, memory_order_relaxed)) {
+      atomic_store_explicit(&obj->is_marked, false, memory_order_relaxed);
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+// Root array of vectors, plus one unreachable integer per vector
+static snek_object_t* build_wide_heap(vm_t* vm, frame_t* frame, size_t n) {
+  snek_object_t* array = new_snek_array(vm, n);
+  frame_reference_object(frame, array);
+  for (size_t i = 0; i < n; ++i) {
+    snek_object_t* vec =
+        new_snek_vector3(vm, new_snek_integer(vm, i), new_snek_integer(vm, 0),
+                         new_snek_integer(vm, 0));
+    snek_array_set(array, i, vec);
+    new_snek_integer(vm, -1);
+  }
+  return array;
+}
+
+static MunitResult test_parallel_matches_serial(const MunitParameter params[],
+                                                void* data) {
+  size_t n = 10 * MARK_CHUNK + 7;
+
+  for (size_t threads = 1; threads <= 4; ++threads) {
+    vm_t* vm = vm_new();
+    vm->mark_threads = threads;
+    frame_t* f1 = vm_new_frame(vm);
+
+    snek_object_t* array = build_wide_heap(vm, f1, n);
+    munit_assert_int(vm->objects->count, ==, 5 * n + 1);
+
+    vm_collect_garbage(vm);
+    munit_assert_int(vm->objects->count, ==, 4 * n + 1);
+    for (size_t i = 0; i < n; ++i) {
+      snek_object_t* vec = snek_array_get(array, i);
+      munit_assert_int(vec->data.v_vector3.x->data.v_int, ==, i);
+      munit_assert_false(vec->is_marked);
+    }
+
+    frame_free(vm_frame_pop(vm));
+    vm_collect_garbage(vm);
+    munit_assert_int(vm->objects->count, ==, 0);
+
+    vm_free(vm);
+    munit_assert_true(boot_all_freed());
+  }
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_shared_children(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new();
+  vm->mark_threads = 4;
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Every vector points at the same three integers, each must be claimed
+  // by exactly one worker and survive exactly once.
+  snek_object_t* x = new_snek_integer(vm, 1);
+  snek_object_t* y = new_snek_integer(vm, 2);
+  snek_object_t* z = new_snek_integer(vm, 3);
+  snek_object_t* array = new_snek_array(vm, 4 * MARK_CHUNK);
+  frame_reference_object(f1, array);
+  for (size_t i = 0; i < 4 * MARK_CHUNK; ++i) {
+    snek_array_set(array, i, new_snek_vector3(vm, x, y, z));
+  }
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->objects->count, ==, 4 * MARK_CHUNK + 4);
+  munit_assert_false(boot_is_freed(x));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_full(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  vm->mark_threads = 2;
+  frame_t* f1 = vm_new_frame(vm);
+  frame_t* f2 = vm_new_frame(vm);
+  frame_t* f3 = vm_new_frame(vm);
+
+  snek_object_t* s1 = new_snek_string(vm, "This string is going into frame 1");
+  frame_reference_object(f1, s1);
+
+  snek_object_t* s2 = new_snek_string(vm, "This string is going into frame 2");
+  frame_reference_object(f2, s2);
+
+  snek_object_t* s3 = new_snek_string(vm, "This string is going into frame 3");
+  frame_reference_object(f3, s3);
+
+  snek_object_t* i1 = new_snek_integer(vm, 69);
+  snek_object_t* i2 = new_snek_integer(vm, 420);
+  snek_object_t* i3 = new_snek_integer(vm, 1337);
+  snek_object_t* v = new_snek_vector3(vm, i1, i2, i3);
+
+  frame_reference_object(f2, v);
+  frame_reference_object(f3, v);
+
+  munit_assert_int(vm->objects->count, ==, 7);
+
+  // only free the top frame (f3)
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_false(boot_is_freed(s1));
+  munit_assert_false(boot_is_freed(s2));
+  munit_assert_false(boot_is_freed(i1));
+
+  frame_free(vm_frame_pop(vm));
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  munit_assert_true(boot_is_freed(s1));
+  munit_assert_true(boot_is_freed(s2));
+  munit_assert_true(boot_is_freed(s3));
+  munit_assert_true(boot_is_freed(v));
+  munit_assert_true(boot_is_freed(i1));
+  munit_assert_true(boot_is_freed(i2));
+  munit_assert_true(boot_is_freed(i3));
+  munit_assert_int(vm->objects->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_parallel_matches_serial", test_parallel_matches_serial, NULL,
+       NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_shared_children", test_shared_children, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_full", test_full, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "parallel-mark",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
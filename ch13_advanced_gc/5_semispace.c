@@ -0,0 +1,913 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+  snek_object_t* v_forward;  // an evacuated object points to its copy
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+  bool is_forwarded;  // from-space object that was copied to to-space
+} snek_object_t;
+
+// Only for the mark-sweep engine, copied objects own no separate buffers
+void snek_object_free(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  free(obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// A vm picks its collector when it is made. GC_COPYING bump-allocates into
+// the current semispace and evacuates whatever the frames can reach, the dead
+// are never visited.
+#define SEMISPACE_BYTES (256 * 1024)
+
+typedef enum GcMode {
+  GC_MARK_SWEEP,
+  GC_COPYING,
+} gc_mode_t;
+
+typedef struct SpaceBlock {
+  struct SpaceBlock* next;
+  size_t size;
+  char data[];
+} space_block_t;
+
+// The current semispace. It is normally one block, more are chained on when
+// it fills up between collections, since we never collect behind the
+// caller's back (its arguments are not rooted).
+typedef struct Space {
+  space_block_t* blocks;  // newest first, top and end point into it
+  char* top;
+  char* end;
+  size_t used;  // bytes handed out over all blocks
+} space_t;
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  gc_mode_t gc_mode;
+  stack_t* objects;  // GC_MARK_SWEEP only
+  space_t space;     // GC_COPYING only
+  size_t semispace_bytes;
+  size_t bytes_copied;  // by the last copying collection
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+space_block_t* space_block_new(size_t size) {
+  space_block_t* block = malloc(sizeof(space_block_t) + size);
+  if (block == NULL) {
+    return NULL;
+  }
+
+  block->next = NULL;
+  block->size = size;
+  return block;
+}
+
+void space_free(space_t* space) {
+  space_block_t* block = space->blocks;
+  while (block != NULL) {
+    space_block_t* next = block->next;
+    free(block);
+    block = next;
+  }
+
+  *space = (space_t){0};
+}
+
+// Makes block the whole space, with the first used bytes already taken
+void space_reset(space_t* space, space_block_t* block, size_t used) {
+  space->blocks = block;
+  space->top = block->data + used;
+  space->end = block->data + block->size;
+  space->used = used;
+}
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->gc_mode = GC_MARK_SWEEP;
+  vm->objects = stack_new(8);
+  vm->space = (space_t){0};
+  vm->semispace_bytes = 0;
+  vm->bytes_copied = 0;
+  return vm;
+}
+
+vm_t* vm_new_copying(size_t semispace_bytes) {
+  vm_t* vm = vm_new();
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  space_block_t* block = space_block_new(semispace_bytes);
+  if (block == NULL) {
+    stack_free(vm->frames);
+    stack_free(vm->objects);
+    free(vm);
+    return NULL;
+  }
+
+  vm->gc_mode = GC_COPYING;
+  vm->semispace_bytes = semispace_bytes;
+  space_reset(&vm->space, block, 0);
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  space_free(&vm->space);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Copying-------------------------------------
+// A string's bytes or an array's elements sit right behind the object, in the
+// same bump allocation, so one memcpy moves both.
+#define SPACE_ALIGN (sizeof(void*))
+
+size_t space_round(size_t bytes) {
+  return (bytes + SPACE_ALIGN - 1) & ~(SPACE_ALIGN - 1);
+}
+
+void* snek_payload(snek_object_t* obj) {
+  return obj + 1;
+}
+
+size_t snek_object_bytes(snek_object_t* obj) {
+  size_t payload = 0;
+  switch (obj->kind) {
+    case STRING:
+      payload = strlen(obj->data.v_string) + 1;
+      break;
+    case ARRAY:
+      payload = obj->data.v_array.size * sizeof(snek_object_t*);
+      break;
+    default:
+      break;
+  }
+  return space_round(sizeof(snek_object_t) + payload);
+}
+
+void* space_alloc(vm_t* vm, size_t bytes) {
+  space_t* space = &vm->space;
+  bytes = space_round(bytes);
+
+  if ((size_t)(space->end - space->top) < bytes) {
+    size_t size = bytes > vm->semispace_bytes ? bytes : vm->semispace_bytes;
+    space_block_t* block = space_block_new(size);
+    if (block == NULL) {
+      return NULL;
+    }
+
+    block->next = space->blocks;
+    space->blocks = block;
+    space->top = block->data;
+    space->end = block->data + size;
+  }
+
+  void* ptr = space->top;
+  space->top += bytes;
+  space->used += bytes;
+  memset(ptr, 0, bytes);
+  return ptr;
+}
+
+bool space_contains(space_t* space, void* ptr) {
+  for (space_block_t* block = space->blocks; block; block = block->next) {
+    if ((char*)ptr >= block->data && (char*)ptr < block->data + block->size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Copies obj to the free end of to-space the first time it is reached, and
+// leaves a forwarding pointer behind so every later reference finds the copy.
+snek_object_t* copying_evacuate(char** free_ptr, snek_object_t* obj) {
+  if (obj == NULL) {
+    return NULL;
+  }
+  if (obj->is_forwarded) {
+    return obj->data.v_forward;
+  }
+
+  size_t bytes = snek_object_bytes(obj);
+  snek_object_t* copy = (snek_object_t*)*free_ptr;
+  memcpy(copy, obj, bytes);
+  *free_ptr += bytes;
+
+  // The payload moved along with it
+  if (copy->kind == STRING) {
+    copy->data.v_string = snek_payload(copy);
+  } else if (copy->kind == ARRAY) {
+    copy->data.v_array.elements = snek_payload(copy);
+  }
+
+  obj->is_forwarded = true;
+  obj->data.v_forward = copy;
+  return copy;
+}
+
+void copying_scan_object(char** free_ptr, snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3: {
+      snek_vector_t* vec = &obj->data.v_vector3;
+      vec->x = copying_evacuate(free_ptr, vec->x);
+      vec->y = copying_evacuate(free_ptr, vec->y);
+      vec->z = copying_evacuate(free_ptr, vec->z);
+      return;
+    }
+    case ARRAY: {
+      snek_array_t* arr = &obj->data.v_array;
+      for (size_t i = 0; i < arr->size; ++i) {
+        arr->elements[i] = copying_evacuate(free_ptr, arr->elements[i]);
+      }
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+// Cheney's algorithm. Everything between scan and free_ptr is gray, so
+// to-space itself is the breadth-first queue and no stack is needed. The
+// cost is roots + live bytes, garbage is dropped with its block.
+void copying_collect(vm_t* vm) {
+  // Live data can't outgrow what was allocated, so one block always fits
+  size_t size = vm->space.used > vm->semispace_bytes ? vm->space.used
+                                                     : vm->semispace_bytes;
+  space_block_t* to_space = space_block_new(size);
+  if (to_space == NULL) {
+    // Unable to get a to-space, just exit :) get gud
+    exit(1);
+  }
+
+  char* scan = to_space->data;
+  char* free_ptr = to_space->data;
+
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      frame->references->data[j] =
+          copying_evacuate(&free_ptr, frame->references->data[j]);
+    }
+  }
+
+  while (scan < free_ptr) {
+    snek_object_t* obj = (snek_object_t*)scan;
+    copying_scan_object(&free_ptr, obj);
+    scan += snek_object_bytes(obj);
+  }
+
+  // From-space only holds garbage and forwarding pointers now
+  space_free(&vm->space);
+  vm->bytes_copied = free_ptr - to_space->data;
+  space_reset(&vm->space, to_space, vm->bytes_copied);
+
+  // Keep collections from running back to back once live data fills most of
+  // the space.
+  if (vm->bytes_copied * 2 > vm->semispace_bytes) {
+    vm->semispace_bytes *= 2;
+  }
+}
+//-----------------------------------------------------------------------------
+//-------------------------------Mark-sweep------------------------------------
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+// Objects move under GC_COPYING, only the frames' references are updated.
+// Pointers held anywhere else are stale after this returns.
+void vm_collect_garbage(vm_t* vm) {
+  if (vm->gc_mode == GC_COPYING) {
+    copying_collect(vm);
+    return;
+  }
+
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+// Under GC_COPYING the payload bytes come with the object, the mark-sweep
+// engine mallocs them separately as before.
+snek_object_t* _new_snek_object(vm_t* vm, size_t payload) {
+  if (vm->gc_mode == GC_COPYING) {
+    return space_alloc(vm, sizeof(snek_object_t) + payload);
+  }
+
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  size_t payload = size * sizeof(snek_object_t*);
+  snek_object_t* obj = _new_snek_object(vm, payload);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = vm->gc_mode == GC_COPYING
+                                 ? snek_payload(obj)
+                                 : calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm, 0);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm, 0);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm, 0);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  int len = strlen(value);
+  snek_object_t* obj = _new_snek_object(vm, len + 1);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  char* dst = vm->gc_mode == GC_COPYING ? snek_payload(obj) : malloc(len + 1);
+  if (dst == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_bump_allocation(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new_copying(SEMISPACE_BYTES);
+  boot_stats_t before = boot_stats();
+
+  snek_object_t* a = new_snek_integer(vm, 1);
+  snek_object_t* b = new_snek_integer(vm, 2);
+  snek_object_t* s = new_snek_string(vm, "snek");
+  snek_object_t* c = new_snek_integer(vm, 3);
+  for (int i = 0; i < 1000; ++i) {
+    new_snek_integer(vm, i);
+  }
+
+  // Neighbours in memory, with the string's bytes inline, and not a single
+  // malloc for any of it
+  munit_assert_ptr_equal(b, a + 1);
+  munit_assert_ptr_equal(s, b + 1);
+  munit_assert_ptr_equal(s->data.v_string, s + 1);
+  munit_assert_string_equal(s->data.v_string, "snek");
+  munit_assert_ptr_equal(c, (char*)(s + 1) + space_round(5));
+  munit_assert_int(boot_stats().alloc_count - before.alloc_count, ==, 0);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->bytes_copied, ==, 0);
+  munit_assert_int(vm->space.used, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_simple(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new_copying(SEMISPACE_BYTES);
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "I wish I knew how to read.");
+  frame_reference_object(f1, s);
+
+  vm_collect_garbage(vm);
+  // It survived, somewhere else, and the frame was told where
+  snek_object_t* moved = f1->references->data[0];
+  munit_assert_ptr_not_equal(moved, s);
+  munit_assert_true(space_contains(&vm->space, moved));
+  munit_assert_string_equal(moved->data.v_string, "I wish I knew how to read.");
+  munit_assert_int(vm->bytes_copied, ==, snek_object_bytes(moved));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->space.used, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_forwarding(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new_copying(SEMISPACE_BYTES);
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* shared = new_snek_integer(vm, 7);
+  snek_object_t* v = new_snek_vector3(vm, shared, shared,
+                                      new_snek_float(vm, 2.5));
+  snek_object_t* arr = new_snek_array(vm, 4);
+  snek_array_set(arr, 0, v);
+  snek_array_set(arr, 1, shared);
+  snek_array_set(arr, 2, arr);
+  snek_array_set(arr, 3, new_snek_string(vm, "hiss"));
+  frame_reference_object(f1, arr);
+  frame_reference_object(f1, shared);
+
+  vm_collect_garbage(vm);
+
+  snek_object_t* new_arr = f1->references->data[0];
+  snek_object_t* new_shared = f1->references->data[1];
+  snek_object_t* new_v = snek_array_get(new_arr, 0);
+
+  // Every path to an object ends at the same copy, cycles included
+  munit_assert_ptr_equal(snek_array_get(new_arr, 1), new_shared);
+  munit_assert_ptr_equal(snek_array_get(new_arr, 2), new_arr);
+  munit_assert_ptr_equal(new_v->data.v_vector3.x, new_shared);
+  munit_assert_ptr_equal(new_v->data.v_vector3.y, new_shared);
+  munit_assert_true(space_contains(&vm->space, new_v->data.v_vector3.z));
+
+  munit_assert_int(new_shared->data.v_int, ==, 7);
+  munit_assert_float(new_v->data.v_vector3.z->data.v_float, ==, 2.5);
+  munit_assert_string_equal(snek_array_get(new_arr, 3)->data.v_string, "hiss");
+  munit_assert_ptr_equal(new_arr->data.v_array.elements, new_arr + 1);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_breadth_first(const MunitParameter params[],
+                                      void* data) {
+  vm_t* vm = vm_new_copying(SEMISPACE_BYTES);
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Allocated children first, so allocation order isn't what we check
+  snek_object_t* leaf = new_snek_integer(vm, 3);
+  snek_object_t* inner = new_snek_array(vm, 1);
+  snek_array_set(inner, 0, leaf);
+  snek_object_t* left = new_snek_integer(vm, 1);
+  snek_object_t* root = new_snek_array(vm, 2);
+  snek_array_set(root, 0, inner);
+  snek_array_set(root, 1, left);
+  frame_reference_object(f1, root);
+
+  vm_collect_garbage(vm);
+
+  // root, then both its children, then the grandchild
+  char* expected = (char*)f1->references->data[0];
+  snek_object_t* order[4];
+  order[0] = f1->references->data[0];
+  order[1] = snek_array_get(order[0], 0);
+  order[2] = snek_array_get(order[0], 1);
+  order[3] = snek_array_get(order[1], 0);
+  for (int i = 0; i < 4; ++i) {
+    munit_assert_ptr_equal(order[i], expected);
+    expected += snek_object_bytes(order[i]);
+  }
+  munit_assert_int(order[3]->data.v_int, ==, 3);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_cost_is_live_data(const MunitParameter params[],
+                                          void* data) {
+  // A small semispace, so the garbage spills into chained blocks
+  vm_t* vm = vm_new_copying(4096);
+  frame_t* f1 = vm_new_frame(vm);
+
+  for (int i = 0; i < 10000; ++i) {
+    snek_object_t* obj = new_snek_integer(vm, i);
+    if (i % 1000 == 0) {
+      frame_reference_object(f1, obj);
+    }
+  }
+  munit_assert_int(vm->space.used, ==, 10000 * sizeof(snek_object_t));
+  munit_assert_not_null(vm->space.blocks->next);
+
+  vm_collect_garbage(vm);
+
+  // Ten survivors copied into one block, the rest was never looked at
+  munit_assert_int(vm->bytes_copied, ==, 10 * sizeof(snek_object_t));
+  munit_assert_null(vm->space.blocks->next);
+  for (int i = 0; i < 10; ++i) {
+    snek_object_t* obj = f1->references->data[i];
+    munit_assert_int(obj->data.v_int, ==, i * 1000);
+  }
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_mark_sweep_mode(const MunitParameter params[],
+                                        void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "stays put");
+  frame_reference_object(f1, s);
+  new_snek_array(vm, 4);
+
+  vm_collect_garbage(vm);
+  munit_assert_ptr_equal(f1->references->data[0], s);
+  munit_assert_int(vm->objects->count, ==, 1);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(s));
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_bump_allocation", test_bump_allocation, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_forwarding", test_forwarding, NULL, NULL, MUNIT_TEST_OPTION_NONE,
+       NULL},
+      {"/test_breadth_first", test_breadth_first, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_cost_is_live_data", test_cost_is_live_data, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_mark_sweep_mode", test_mark_sweep_mode, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "semispace",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,924 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+// Fixed-size objects are carved out of large pages. Released objects are
+// threaded onto an intrusive free list and handed out again before any new
+// page is touched, so alloc and release are a couple of pointer ops. Pages
+// are kept oldest first, the order compaction slides objects in.
+#define POOL_PAGE_SIZE (64 * 1024)
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  char objects[];
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  size_t count;       // live objects
+  size_t free_count;  // slots on the free list
+  pool_page_t* pages;
+  pool_page_t* last;  // newest page, the one bump points into
+  pool_slot_t* free_list;
+  char* bump;  // next never-used object in the newest page
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // Every slot must be able to hold the free list link, and stay aligned
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  pool->object_size = object_size;
+  pool->objects_per_page =
+      (POOL_PAGE_SIZE - sizeof(pool_page_t)) / object_size;
+  pool->count = 0;
+  pool->free_count = 0;
+  pool->pages = NULL;
+  pool->last = NULL;
+  pool->free_list = NULL;
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  pool_page_t* page = malloc(POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = NULL;
+  if (pool->last != NULL) {
+    pool->last->next = page;
+  } else {
+    pool->pages = page;
+  }
+  pool->last = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+    pool->free_count--;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  // Same contract as the calloc it replaces
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_slot_t* slot = obj;
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  pool->count--;
+  pool->free_count++;
+}
+
+// Share of the handed out slots that sit unused on the free list
+int pool_fragmentation_percent(pool_t* pool) {
+  size_t slots = pool->count + pool->free_count;
+  if (slots == 0) {
+    return 0;
+  }
+  return pool->free_count * 100 / slots;
+}
+
+size_t pool_page_count(pool_t* pool) {
+  size_t count = 0;
+  for (pool_page_t* page = pool->pages; page != NULL; page = page->next) {
+    count++;
+  }
+  return count;
+}
+
+void pool_free(pool_t* pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+  // Where compaction will slide the object, only valid during a compaction.
+  // The extra word is what lets every reference be fixed before anything
+  // moves.
+  snek_object_t* forward;
+} snek_object_t;
+
+void snek_object_free(pool_t* pool, snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+  pool_release(pool, obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+// Collections sweep into the pool's free list as usual. Once the free slots
+// are over compact_percent of the heap and add up to at least a page, the
+// live objects are slid down instead, and the emptied pages go back.
+#define COMPACT_FRAGMENTATION_PERCENT 50
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  pool_t* heap;
+  int compact_percent;  // negative turns automatic compaction off
+  size_t compactions;
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->heap = pool_new(sizeof(snek_object_t));
+  vm->compact_percent = COMPACT_FRAGMENTATION_PERCENT;
+  vm->compactions = 0;
+  return vm;
+}
+
+void vm_free(vm_t* vm) {
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  pool_free(vm->heap);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+void sweep(vm_t* vm) {
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      obj->is_marked = false;
+    } else {
+      snek_object_free(vm->heap, obj);
+      vm->objects->data[i] = NULL;
+    }
+  }
+
+  stack_remove_nulls(vm->objects);
+}
+
+void vm_compact(vm_t* vm);
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+
+  pool_t* heap = vm->heap;
+  if (vm->compact_percent >= 0 && heap->free_count >= heap->objects_per_page &&
+      pool_fragmentation_percent(heap) > vm->compact_percent) {
+    vm_compact(vm);
+  }
+}
+//-----------------------------------------------------------------------------
+//--------------------------------Compaction-----------------------------------
+// Walks every slot ever handed out, oldest page first. Only the newest page
+// stops short, at the bump pointer.
+typedef struct SlotCursor {
+  pool_t* pool;
+  pool_page_t* page;
+  size_t index;
+} slot_cursor_t;
+
+slot_cursor_t slot_cursor_new(pool_t* pool) {
+  return (slot_cursor_t){.pool = pool, .page = pool->pages, .index = 0};
+}
+
+snek_object_t* slot_cursor_at(slot_cursor_t* cursor) {
+  return (snek_object_t*)(cursor->page->objects +
+                          cursor->index * cursor->pool->object_size);
+}
+
+// Moves to the next slot, false once past the last handed out one
+bool slot_cursor_next(slot_cursor_t* cursor, snek_object_t** slot) {
+  pool_t* pool = cursor->pool;
+  while (cursor->page != NULL) {
+    if (cursor->index < pool->objects_per_page) {
+      snek_object_t* obj = slot_cursor_at(cursor);
+      if (cursor->page == pool->last && (char*)obj >= pool->bump) {
+        return false;
+      }
+
+      cursor->index++;
+      *slot = obj;
+      return true;
+    }
+
+    cursor->page = cursor->page->next;
+    cursor->index = 0;
+  }
+  return false;
+}
+
+snek_object_t* compact_forward(snek_object_t* obj) {
+  return obj == NULL ? NULL : obj->forward;
+}
+
+void compact_update_object(snek_object_t* obj) {
+  switch (obj->kind) {
+    case VECTOR3: {
+      snek_vector_t* vec = &obj->data.v_vector3;
+      vec->x = compact_forward(vec->x);
+      vec->y = compact_forward(vec->y);
+      vec->z = compact_forward(vec->z);
+      return;
+    }
+    case ARRAY: {
+      snek_array_t* arr = &obj->data.v_array;
+      for (size_t i = 0; i < arr->size; ++i) {
+        arr->elements[i] = compact_forward(arr->elements[i]);
+      }
+      return;
+    }
+    default:
+      return;
+  }
+}
+
+// LISP2 sliding compaction of a swept heap. Every object left in vm->objects
+// is live, so they are flagged again and three passes over the slots slide
+// them to the low end of the heap in address order:
+//   1. give each live object the next free slot from the bottom
+//   2. point the roots and every field at the new addresses
+//   3. move the objects, never upwards, so nothing is overwritten too early
+// Free slots still carry the cleared mark of the dead object they held.
+// Called on its own, objects that died since the last sweep just ride along.
+void vm_compact(vm_t* vm) {
+  pool_t* heap = vm->heap;
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    obj->is_marked = true;
+  }
+
+  slot_cursor_t scan = slot_cursor_new(heap);
+  slot_cursor_t to = slot_cursor_new(heap);
+  snek_object_t* obj;
+  snek_object_t* dest;
+  while (slot_cursor_next(&scan, &obj)) {
+    if (obj->is_marked) {
+      slot_cursor_next(&to, &dest);
+      obj->forward = dest;
+    }
+  }
+
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      frame->references->data[j] =
+          compact_forward(frame->references->data[j]);
+    }
+  }
+
+  scan = slot_cursor_new(heap);
+  while (slot_cursor_next(&scan, &obj)) {
+    if (obj->is_marked) {
+      compact_update_object(obj);
+    }
+  }
+
+  // vm->objects is rebuilt in slot order as the objects land
+  vm->objects->count = 0;
+  scan = slot_cursor_new(heap);
+  while (slot_cursor_next(&scan, &obj)) {
+    if (obj->is_marked) {
+      dest = obj->forward;
+      if (dest != obj) {
+        memcpy(dest, obj, heap->object_size);
+      }
+      dest->is_marked = false;
+      dest->forward = NULL;
+      stack_push(vm->objects, dest);
+    }
+  }
+
+  // Everything past the last moved object is free again. The page it landed
+  // in is where bumping resumes, the pages after it are released.
+  pool_page_t* keep = vm->objects->count > 0 ? to.page : NULL;
+  pool_page_t* page = keep != NULL ? keep->next : heap->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  heap->free_list = NULL;
+  heap->free_count = 0;
+  heap->count = vm->objects->count;
+  if (keep == NULL) {
+    heap->pages = NULL;
+    heap->last = NULL;
+    heap->bump = NULL;
+    heap->bump_end = NULL;
+  } else {
+    keep->next = NULL;
+    heap->last = keep;
+    heap->bump = keep->objects + to.index * heap->object_size;
+    heap->bump_end =
+        keep->objects + heap->objects_per_page * heap->object_size;
+  }
+
+  vm->compactions++;
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = pool_alloc(vm->heap);
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    // Already tracked by the vm, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    // Already tracked by the vm, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_compact_on_demand(const MunitParameter params[],
+                                          void* data) {
+  vm_t* vm = vm_new();
+  vm->compact_percent = -1;
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Three pages of integers, one in ten survives
+  size_t count = 3 * vm->heap->objects_per_page;
+  for (size_t i = 0; i < count; ++i) {
+    snek_object_t* obj = new_snek_integer(vm, i);
+    if (i % 10 == 0) {
+      frame_reference_object(f1, obj);
+    }
+  }
+  size_t live = f1->references->count;
+
+  vm_collect_garbage(vm);
+  munit_assert_int(pool_page_count(vm->heap), ==, 3);
+  munit_assert_int(pool_fragmentation_percent(vm->heap), ==,
+                   (count - live) * 100 / count);
+  munit_assert_int(vm->compactions, ==, 0);
+
+  vm_compact(vm);
+  munit_assert_int(vm->compactions, ==, 1);
+  munit_assert_int(pool_page_count(vm->heap), ==, 1);
+  munit_assert_int(pool_fragmentation_percent(vm->heap), ==, 0);
+  munit_assert_int(vm->heap->count, ==, live);
+
+  // Packed at the bottom of the first page, still in allocation order
+  snek_object_t* first = (snek_object_t*)vm->heap->pages->objects;
+  for (size_t i = 0; i < live; ++i) {
+    snek_object_t* obj = f1->references->data[i];
+    munit_assert_ptr_equal(obj, first + i);
+    munit_assert_int(obj->data.v_int, ==, i * 10);
+    munit_assert_false(obj->is_marked);
+  }
+
+  // New objects are bumped in right behind them
+  snek_object_t* next = new_snek_integer(vm, -1);
+  munit_assert_ptr_equal(next, first + live);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_compact(vm);
+  munit_assert_int(pool_page_count(vm->heap), ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_references_updated(const MunitParameter params[],
+                                           void* data) {
+  vm_t* vm = vm_new();
+  vm->compact_percent = -1;
+  frame_t* f1 = vm_new_frame(vm);
+
+  // Garbage below everything, so every survivor has to move
+  for (int i = 0; i < 100; ++i) {
+    new_snek_integer(vm, i);
+  }
+
+  snek_object_t* s = new_snek_string(vm, "hiss");
+  char* bytes = s->data.v_string;
+  snek_object_t* x = new_snek_integer(vm, 1);
+  snek_object_t* v = new_snek_vector3(vm, x, x, new_snek_float(vm, 2.5));
+  snek_object_t* arr = new_snek_array(vm, 3);
+  snek_array_set(arr, 0, v);
+  snek_array_set(arr, 1, s);
+  snek_array_set(arr, 2, arr);
+  frame_reference_object(f1, arr);
+
+  vm_collect_garbage(vm);
+  vm_compact(vm);
+
+  snek_object_t* new_arr = f1->references->data[0];
+  snek_object_t* new_v = snek_array_get(new_arr, 0);
+  snek_object_t* new_s = snek_array_get(new_arr, 1);
+  munit_assert_ptr_not_equal(new_arr, arr);
+  munit_assert_ptr_equal(snek_array_get(new_arr, 2), new_arr);
+  munit_assert_ptr_equal(new_v->data.v_vector3.x, new_v->data.v_vector3.y);
+  munit_assert_int(new_v->data.v_vector3.x->data.v_int, ==, 1);
+  munit_assert_float(new_v->data.v_vector3.z->data.v_float, ==, 2.5);
+
+  // Only the object slides, its buffer stays where it was
+  munit_assert_ptr_equal(new_s->data.v_string, bytes);
+  munit_assert_string_equal(new_s->data.v_string, "hiss");
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_fragmentation_triggers(const MunitParameter params[],
+                                               void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  size_t count = 4 * vm->heap->objects_per_page;
+  for (size_t i = 0; i < count; ++i) {
+    snek_object_t* obj = new_snek_string(vm, "snek");
+    if (i % 4 == 0) {
+      frame_reference_object(f1, obj);
+    }
+  }
+
+  // 75% of the heap died, past the default threshold
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->compactions, ==, 1);
+  munit_assert_int(pool_page_count(vm->heap), ==, 1);
+
+  // A heap with nothing to give back is left alone
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->compactions, ==, 1);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_sweep_recycles(const MunitParameter params[],
+                                       void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead = new_snek_integer(vm, 1);
+  snek_object_t* live = new_snek_integer(vm, 2);
+  frame_reference_object(f1, live);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+
+  // The swept slot is the first one handed out again, zeroed
+  snek_object_t* reused = new_snek_float(vm, 4.2);
+  munit_assert_ptr_equal(reused, dead);
+  munit_assert_false(reused->is_marked);
+  munit_assert_int(live->data.v_int, ==, 2);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_compact_on_demand", test_compact_on_demand, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_references_updated", test_references_updated, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_fragmentation_triggers", test_fragmentation_triggers, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_sweep_recycles", test_sweep_recycles, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "mark-compact",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,978 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../munit/munit.h"
+#include "../bootlib.h"
+//-----------------------------------------------------------------------------
+//----------------------------------Pool---------------------------------------
+// Fixed-size objects are carved out of large pages. Released objects are
+// threaded onto an intrusive free list and handed out again before any new
+// page is touched, so alloc and release are a couple of pointer ops.
+//
+// Slots freed by the background sweeper don't go on the free list, which only
+// the mutator touches. They are pushed onto a separate lock-free reclaimed
+// list, and the allocator takes that whole list in one exchange once its own
+// free list runs dry. With a single consumer taking everything at once there
+// is no ABA to worry about.
+#define POOL_PAGE_SIZE (64 * 1024)
+
+typedef struct PoolSlot {
+  struct PoolSlot* next;
+} pool_slot_t;
+
+typedef struct PoolPage {
+  struct PoolPage* next;
+  char objects[];
+} pool_page_t;
+
+typedef struct Pool {
+  size_t object_size;
+  size_t objects_per_page;
+  atomic_size_t count;  // live objects
+  pool_page_t* pages;
+  pool_slot_t* free_list;
+  _Atomic(pool_slot_t*) reclaimed;  // pushed by the sweeper thread
+  char* bump;  // next never-used object in the newest page
+  char* bump_end;
+} pool_t;
+
+pool_t* pool_new(size_t object_size) {
+  pool_t* pool = malloc(sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  // Every slot must be able to hold the free list link, and stay aligned
+  if (object_size < sizeof(pool_slot_t)) {
+    object_size = sizeof(pool_slot_t);
+  }
+  object_size = (object_size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+  pool->object_size = object_size;
+  pool->objects_per_page =
+      (POOL_PAGE_SIZE - sizeof(pool_page_t)) / object_size;
+  pool->count = 0;
+  pool->pages = NULL;
+  pool->free_list = NULL;
+  atomic_init(&pool->reclaimed, NULL);
+  pool->bump = NULL;
+  pool->bump_end = NULL;
+  return pool;
+}
+
+static bool pool_grow(pool_t* pool) {
+  pool_page_t* page = malloc(POOL_PAGE_SIZE);
+  if (page == NULL) {
+    return false;
+  }
+
+  page->next = pool->pages;
+  pool->pages = page;
+  pool->bump = page->objects;
+  pool->bump_end = page->objects + pool->objects_per_page * pool->object_size;
+  return true;
+}
+
+void* pool_alloc(pool_t* pool) {
+  void* obj;
+  if (pool->free_list == NULL) {
+    pool->free_list = atomic_exchange_explicit(&pool->reclaimed, NULL,
+                                               memory_order_acquire);
+  }
+
+  if (pool->free_list != NULL) {
+    obj = pool->free_list;
+    pool->free_list = pool->free_list->next;
+  } else {
+    if (pool->bump == pool->bump_end && !pool_grow(pool)) {
+      return NULL;
+    }
+    obj = pool->bump;
+    pool->bump += pool->object_size;
+  }
+
+  // Same contract as the calloc it replaces
+  memset(obj, 0, pool->object_size);
+  pool->count++;
+  return obj;
+}
+
+void pool_release(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_slot_t* slot = obj;
+  slot->next = pool->free_list;
+  pool->free_list = slot;
+  pool->count--;
+}
+
+// Safe from any thread, the slot reaches the allocator on its next refill
+void pool_release_shared(pool_t* pool, void* obj) {
+  if (obj == NULL) {
+    return;
+  }
+
+  pool_slot_t* slot = obj;
+  slot->next = atomic_load_explicit(&pool->reclaimed, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&pool->reclaimed, &slot->next,
+                                                slot, memory_order_release,
+                                                memory_order_relaxed)) {
+  }
+  pool->count--;
+}
+
+void pool_free(pool_t* pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pool_page_t* page = pool->pages;
+  while (page != NULL) {
+    pool_page_t* next = page->next;
+    free(page);
+    page = next;
+  }
+
+  free(pool);
+}
+//-----------------------------------------------------------------------------
+//----------------------------------Snek---------------------------------------
+typedef struct SnekObject snek_object_t;
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  char* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+  bool is_marked;
+} snek_object_t;
+
+// Frees what the object owns, not the object itself
+void snek_object_free_data(snek_object_t* obj) {
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+      break;
+    case STRING:
+      free(obj->data.v_string);
+      break;
+    case VECTOR3: {
+      break;
+    }
+    case ARRAY: {
+      free(obj->data.v_array.elements);
+      break;
+    }
+  }
+}
+
+void snek_object_free(pool_t* pool, snek_object_t* obj) {
+  snek_object_free_data(obj);
+  pool_release(pool, obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Stack-------------------------------------
+typedef struct Stack {
+  size_t count;
+  size_t capacity;
+  void** data;
+} stack_t;
+
+void stack_push(stack_t* stack, void* obj) {
+  if (stack->count == stack->capacity) {
+    // Double stack capacity to avoid reallocing often
+    stack->capacity *= 2;
+    stack->data = realloc(stack->data, stack->capacity * sizeof(void*));
+    if (stack->data == NULL) {
+      // Unable to realloc, just exit :) get gud
+      exit(1);
+    }
+  }
+
+  stack->data[stack->count] = obj;
+  stack->count++;
+
+  return;
+}
+
+void* stack_pop(stack_t* stack) {
+  if (stack->count == 0) {
+    return NULL;
+  }
+
+  stack->count--;
+  return stack->data[stack->count];
+}
+
+void stack_free(stack_t* stack) {
+  if (stack == NULL) {
+    return;
+  }
+
+  if (stack->data != NULL) {
+    free(stack->data);
+  }
+
+  free(stack);
+}
+
+void stack_remove_nulls(stack_t* stack) {
+  size_t new_count = 0;
+
+  // Iterate through the stack and compact non-NULL pointers.
+  for (size_t i = 0; i < stack->count; ++i) {
+    if (stack->data[i] != NULL) {
+      stack->data[new_count++] = stack->data[i];
+    }
+  }
+
+  // Update the count to reflect the new number of elements.
+  stack->count = new_count;
+
+  // Optionally, you might want to zero out the remaining slots.
+  for (size_t i = new_count; i < stack->capacity; ++i) {
+    stack->data[i] = NULL;
+  }
+}
+
+stack_t* stack_new(size_t capacity) {
+  stack_t* stack = malloc(sizeof(stack_t));
+  if (stack == NULL) {
+    return NULL;
+  }
+
+  stack->count = 0;
+  stack->capacity = capacity;
+  stack->data = malloc(stack->capacity * sizeof(void*));
+  if (stack->data == NULL) {
+    free(stack);
+    return NULL;
+  }
+
+  return stack;
+}
+//-----------------------------------------------------------------------------
+//----------------------------------VM-----------------------------------------
+typedef struct Sweeper sweeper_t;
+
+typedef struct VirtualMachine {
+  stack_t* frames;
+  stack_t* objects;
+  pool_t* heap;
+  sweeper_t* sweeper;  // NULL sweeps on the mutator, as before
+} vm_t;
+
+typedef struct StackFrame {
+  stack_t* references;
+} frame_t;
+
+void vm_frame_push(vm_t* vm, frame_t* frame) {
+  stack_push(vm->frames, frame);
+}
+
+frame_t* vm_new_frame(vm_t* vm) {
+  frame_t* frame = malloc(sizeof(frame_t));
+  frame->references = stack_new(8);
+  vm_frame_push(vm, frame);
+  return frame;
+}
+
+void frame_free(frame_t* frame) {
+  if (!frame) {
+    return;
+  }
+
+  stack_free(frame->references);
+  free(frame);
+}
+
+// don't touch below this line
+
+vm_t* vm_new() {
+  vm_t* vm = malloc(sizeof(vm_t));
+  if (vm == NULL) {
+    return NULL;
+  }
+
+  vm->frames = stack_new(8);
+  vm->objects = stack_new(8);
+  vm->heap = pool_new(sizeof(snek_object_t));
+  vm->sweeper = NULL;
+  return vm;
+}
+
+void vm_stop_sweeper(vm_t* vm);
+
+void vm_free(vm_t* vm) {
+  // Whatever is still queued is freed before the pool goes away
+  vm_stop_sweeper(vm);
+  for (int i = 0; i < vm->frames->count; i++) {
+    frame_free(vm->frames->data[i]);
+  }
+  stack_free(vm->frames);
+  stack_free(vm->objects);
+  pool_free(vm->heap);
+  free(vm);
+}
+
+void vm_track_object(vm_t* vm, snek_object_t* obj) {
+  if (!vm || !obj) {
+    return;
+  }
+
+  stack_push(vm->objects, obj);
+}
+
+frame_t* vm_frame_pop(vm_t* vm) {
+  return stack_pop(vm->frames);
+}
+
+void frame_reference_object(frame_t* frame, snek_object_t* obj) {
+  if (!frame || !obj) {
+    return;
+  }
+  stack_push(frame->references, obj);
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------Sweeper-------------------------------------
+// The mutator still decides what is dead, that part is a pass over
+// vm->objects. The free() of every dead object's buffers and the release of
+// its slot happen on a background thread, off the request path. Dead objects
+// are unreachable, so once handed over the mutator never touches them again.
+typedef struct SweepBatch {
+  struct SweepBatch* next;
+  size_t count;
+  snek_object_t* objects[];
+} sweep_batch_t;
+
+typedef struct Sweeper {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t work_ready;
+  pthread_cond_t idle;
+  pool_t* pool;
+  sweep_batch_t* head;  // oldest batch first
+  sweep_batch_t* tail;
+  bool busy;
+  bool stopping;
+  atomic_size_t objects_freed;
+} sweeper_t;
+
+void* sweeper_run(void* arg) {
+  sweeper_t* sweeper = arg;
+
+  pthread_mutex_lock(&sweeper->lock);
+  while (true) {
+    while (sweeper->head == NULL && !sweeper->stopping) {
+      pthread_cond_wait(&sweeper->work_ready, &sweeper->lock);
+    }
+    if (sweeper->head == NULL) {
+      break;  // stopping, and nothing left to free
+    }
+
+    sweep_batch_t* batch = sweeper->head;
+    sweeper->head = batch->next;
+    if (sweeper->head == NULL) {
+      sweeper->tail = NULL;
+    }
+    sweeper->busy = true;
+    pthread_mutex_unlock(&sweeper->lock);
+
+    for (size_t i = 0; i < batch->count; ++i) {
+      snek_object_free_data(batch->objects[i]);
+      pool_release_shared(sweeper->pool, batch->objects[i]);
+    }
+    atomic_fetch_add(&sweeper->objects_freed, batch->count);
+    free(batch);
+
+    pthread_mutex_lock(&sweeper->lock);
+    sweeper->busy = false;
+    if (sweeper->head == NULL) {
+      pthread_cond_broadcast(&sweeper->idle);
+    }
+  }
+  pthread_mutex_unlock(&sweeper->lock);
+  return NULL;
+}
+
+bool vm_start_sweeper(vm_t* vm) {
+  if (vm->sweeper != NULL) {
+    return true;
+  }
+
+  sweeper_t* sweeper = malloc(sizeof(sweeper_t));
+  if (sweeper == NULL) {
+    return false;
+  }
+
+  pthread_mutex_init(&sweeper->lock, NULL);
+  pthread_cond_init(&sweeper->work_ready, NULL);
+  pthread_cond_init(&sweeper->idle, NULL);
+  sweeper->pool = vm->heap;
+  sweeper->head = NULL;
+  sweeper->tail = NULL;
+  sweeper->busy = false;
+  sweeper->stopping = false;
+  atomic_init(&sweeper->objects_freed, 0);
+
+  if (pthread_create(&sweeper->thread, NULL, sweeper_run, sweeper) != 0) {
+    pthread_mutex_destroy(&sweeper->lock);
+    pthread_cond_destroy(&sweeper->work_ready);
+    pthread_cond_destroy(&sweeper->idle);
+    free(sweeper);
+    return false;
+  }
+
+  vm->sweeper = sweeper;
+  return true;
+}
+
+void sweeper_enqueue(sweeper_t* sweeper, sweep_batch_t* batch) {
+  batch->next = NULL;
+
+  pthread_mutex_lock(&sweeper->lock);
+  if (sweeper->tail != NULL) {
+    sweeper->tail->next = batch;
+  } else {
+    sweeper->head = batch;
+  }
+  sweeper->tail = batch;
+  pthread_cond_signal(&sweeper->work_ready);
+  pthread_mutex_unlock(&sweeper->lock);
+}
+
+// Blocks until every batch handed over so far has been freed
+void vm_wait_for_sweeper(vm_t* vm) {
+  sweeper_t* sweeper = vm->sweeper;
+  if (sweeper == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&sweeper->lock);
+  while (sweeper->head != NULL || sweeper->busy) {
+    pthread_cond_wait(&sweeper->idle, &sweeper->lock);
+  }
+  pthread_mutex_unlock(&sweeper->lock);
+}
+
+// Drains the queue, joins the thread and goes back to sweeping inline
+void vm_stop_sweeper(vm_t* vm) {
+  sweeper_t* sweeper = vm->sweeper;
+  if (sweeper == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&sweeper->lock);
+  sweeper->stopping = true;
+  pthread_cond_signal(&sweeper->work_ready);
+  pthread_mutex_unlock(&sweeper->lock);
+  pthread_join(sweeper->thread, NULL);
+
+  pthread_mutex_destroy(&sweeper->lock);
+  pthread_cond_destroy(&sweeper->work_ready);
+  pthread_cond_destroy(&sweeper->idle);
+  free(sweeper);
+  vm->sweeper = NULL;
+}
+//-----------------------------------------------------------------------------
+//-------------------------------Mark-sweep------------------------------------
+void mark(vm_t* vm) {
+  for (size_t i = 0; i < vm->frames->count; ++i) {
+    frame_t* frame = vm->frames->data[i];
+
+    for (size_t j = 0; j < frame->references->count; ++j) {
+      snek_object_t* obj = frame->references->data[j];
+      obj->is_marked = true;
+    }
+  }
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj);
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+void trace_blacken_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!gray_objects || !obj) {
+    return;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+    case FLOAT:
+    case STRING:
+      return;
+    case VECTOR3:
+      trace_mark_object(gray_objects, obj->data.v_vector3.x);
+      trace_mark_object(gray_objects, obj->data.v_vector3.y);
+      trace_mark_object(gray_objects, obj->data.v_vector3.z);
+      return;
+    case ARRAY:
+      snek_array_t arr = obj->data.v_array;
+      for (size_t i = 0; i < arr.size; i++) {
+        trace_mark_object(gray_objects, snek_array_get(obj, i));
+      }
+      return;
+    default:
+      return;
+  }
+}
+
+void trace(vm_t* vm) {
+  if (!vm) {
+    return;
+  }
+
+  stack_t* gray_objects = stack_new(8);
+  if (!gray_objects) {
+    return;
+  }
+
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj && obj->is_marked) {
+      stack_push(gray_objects, obj);
+    }
+  }
+
+  while (gray_objects->count) {
+    snek_object_t* obj = stack_pop(gray_objects);
+    trace_blacken_object(gray_objects, obj);
+  }
+
+  stack_free(gray_objects);
+}
+
+void trace_mark_object(stack_t* gray_objects, snek_object_t* obj) {
+  if (!obj || obj->is_marked) {
+    return;
+  }
+
+  obj->is_marked = true;
+  stack_push(gray_objects, obj);
+}
+
+// With a sweeper running, the dead are only unlinked here and handed over as
+// one batch, the mutator never calls free() for them.
+void sweep(vm_t* vm) {
+  sweep_batch_t* batch = NULL;
+  if (vm->sweeper != NULL) {
+    batch = malloc(sizeof(sweep_batch_t) +
+                   vm->objects->count * sizeof(snek_object_t*));
+    if (batch != NULL) {
+      batch->count = 0;
+    }
+  }
+
+  size_t live = 0;
+  for (size_t i = 0; i < vm->objects->count; ++i) {
+    snek_object_t* obj = vm->objects->data[i];
+    if (obj->is_marked) {
+      obj->is_marked = false;
+      vm->objects->data[live++] = obj;
+    } else if (batch != NULL) {
+      batch->objects[batch->count++] = obj;
+    } else {
+      snek_object_free(vm->heap, obj);
+    }
+  }
+  vm->objects->count = live;
+
+  if (batch == NULL) {
+    return;
+  }
+  if (batch->count == 0) {
+    free(batch);
+    return;
+  }
+  sweeper_enqueue(vm->sweeper, batch);
+}
+
+void vm_collect_garbage(vm_t* vm) {
+  mark(vm);
+  trace(vm);
+  sweep(vm);
+}
+//-----------------------------------------------------------------------------
+//-----------------------------------Sneknew-------------------------------------
+snek_object_t* _new_snek_object(vm_t* vm) {
+  snek_object_t* obj = pool_alloc(vm->heap);
+  if (obj == NULL) {
+    return NULL;
+  }
+  vm_track_object(vm, obj);
+  return obj;
+}
+
+// don't touch below this line
+
+snek_object_t* new_snek_array(vm_t* vm, size_t size) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    // Already tracked by the vm, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+
+  return obj;
+}
+
+snek_object_t* new_snek_vector3(vm_t* vm, snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(vm_t* vm, int value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+
+  return obj;
+}
+
+snek_object_t* new_snek_float(vm_t* vm, float value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+snek_object_t* new_snek_string(vm_t* vm, char* value) {
+  snek_object_t* obj = _new_snek_object(vm);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  int len = strlen(value);
+  char* dst = malloc(len + 1);
+  if (dst == NULL) {
+    // Already tracked by the vm, the next sweep hands it back to the pool
+    return NULL;
+  }
+
+  strcpy(dst, value);
+
+  obj->kind = STRING;
+  obj->data.v_string = dst;
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // No need to change refcounts, we will find the garbage values
+  // later through mark-and-sweep.
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+//-----------------------------------------------------------------------------
+//---------------------------------- Tests-------------------------------------
+static MunitResult test_simple(const MunitParameter params[], void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* s = new_snek_string(vm, "I wish I knew how to read.");
+  frame_reference_object(f1, s);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+  munit_assert_false(boot_is_freed(s->data.v_string));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 0);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_sweep_recycles(const MunitParameter params[],
+                                       void* data) {
+  vm_t* vm = vm_new();
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead = new_snek_integer(vm, 1);
+  snek_object_t* live = new_snek_integer(vm, 2);
+  frame_reference_object(f1, live);
+
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+
+  // The swept slot is the first one handed out again, zeroed
+  snek_object_t* reused = new_snek_float(vm, 4.2);
+  munit_assert_ptr_equal(reused, dead);
+  munit_assert_false(reused->is_marked);
+  munit_assert_int(live->data.v_int, ==, 2);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_background_frees(const MunitParameter params[],
+                                         void* data) {
+  vm_t* vm = vm_new();
+  munit_assert_true(vm_start_sweeper(vm));
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* live = new_snek_string(vm, "stays");
+  frame_reference_object(f1, live);
+  snek_object_t* dead = new_snek_string(vm, "goes away");
+  snek_object_t* arr = new_snek_array(vm, 4);
+
+  // Unlinked right away, freed once the sweeper gets to them
+  vm_collect_garbage(vm);
+  munit_assert_int(vm->objects->count, ==, 1);
+
+  vm_wait_for_sweeper(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+  munit_assert_int(vm->sweeper->objects_freed, ==, 2);
+  munit_assert_true(boot_is_freed(dead->data.v_string));
+  munit_assert_true(boot_is_freed(arr->data.v_array.elements));
+  munit_assert_false(boot_is_freed(live->data.v_string));
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_background_recycles(const MunitParameter params[],
+                                            void* data) {
+  vm_t* vm = vm_new();
+  munit_assert_true(vm_start_sweeper(vm));
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead[16];
+  for (size_t i = 0; i < 16; ++i) {
+    dead[i] = new_snek_integer(vm, i);
+  }
+  pool_page_t* pages = vm->heap->pages;
+
+  vm_collect_garbage(vm);
+  vm_wait_for_sweeper(vm);
+  munit_assert_int(vm->heap->count, ==, 0);
+
+  // The allocator picks the reclaimed slots up, no new page is needed
+  for (size_t i = 0; i < 16; ++i) {
+    snek_object_t* obj = new_snek_integer(vm, 100 + i);
+    frame_reference_object(f1, obj);
+
+    bool was_dead = false;
+    for (size_t j = 0; j < 16; ++j) {
+      was_dead |= obj == dead[j];
+    }
+    munit_assert_true(was_dead);
+  }
+  munit_assert_ptr_equal(vm->heap->pages, pages);
+  munit_assert_int(vm->heap->count, ==, 16);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_background_churn(const MunitParameter params[],
+                                         void* data) {
+  vm_t* vm = vm_new();
+  munit_assert_true(vm_start_sweeper(vm));
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* keep = new_snek_integer(vm, 7);
+  frame_reference_object(f1, keep);
+
+  // Collect without waiting, the mutator keeps allocating while the sweeper
+  // hands slots back.
+  for (int round = 0; round < 100; ++round) {
+    for (int i = 0; i < 50; ++i) {
+      snek_object_t* s = new_snek_string(vm, "garbage");
+      snek_object_t* v = new_snek_vector3(vm, s, s, keep);
+      munit_assert_not_null(v);
+    }
+    vm_collect_garbage(vm);
+    munit_assert_int(vm->objects->count, ==, 1);
+  }
+
+  vm_wait_for_sweeper(vm);
+  munit_assert_int(vm->heap->count, ==, 1);
+  munit_assert_int(vm->sweeper->objects_freed, ==, 100 * 50 * 2);
+  munit_assert_int(keep->data.v_int, ==, 7);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_free_drains_sweeper(const MunitParameter params[],
+                                            void* data) {
+  vm_t* vm = vm_new();
+  munit_assert_true(vm_start_sweeper(vm));
+
+  for (int i = 0; i < 100; ++i) {
+    new_snek_string(vm, "still queued when the vm goes");
+  }
+  vm_collect_garbage(vm);
+
+  // No wait, vm_free joins the sweeper after it has emptied the queue
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+static MunitResult test_stop_sweeper(const MunitParameter params[],
+                                     void* data) {
+  vm_t* vm = vm_new();
+  munit_assert_true(vm_start_sweeper(vm));
+  frame_t* f1 = vm_new_frame(vm);
+
+  snek_object_t* dead = new_snek_string(vm, "swept on the thread");
+  vm_collect_garbage(vm);
+  vm_stop_sweeper(vm);
+  munit_assert_null(vm->sweeper);
+  munit_assert_true(boot_is_freed(dead->data.v_string));
+
+  // Back to sweeping inline
+  dead = new_snek_string(vm, "swept inline");
+  frame_reference_object(f1, new_snek_integer(vm, 1));
+  vm_collect_garbage(vm);
+  munit_assert_true(boot_is_freed(dead->data.v_string));
+  munit_assert_int(vm->heap->count, ==, 1);
+
+  frame_free(vm_frame_pop(vm));
+  vm_collect_garbage(vm);
+  vm_free(vm);
+  munit_assert_true(boot_all_freed());
+
+  return MUNIT_OK;
+}
+
+int main() {
+  MunitTest tests[] = {
+      {"/test_simple", test_simple, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_sweep_recycles", test_sweep_recycles, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_background_frees", test_background_frees, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_background_recycles", test_background_recycles, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_background_churn", test_background_churn, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_free_drains_sweeper", test_free_drains_sweeper, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {"/test_stop_sweeper", test_stop_sweeper, NULL, NULL,
+       MUNIT_TEST_OPTION_NONE, NULL},
+      {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
+
+  MunitSuite suite = {
+      .prefix = "background-sweep",
+      .tests = tests,
+      .suites = NULL,
+      .iterations = 1,
+      .options = MUNIT_SUITE_OPTION_NONE,
+  };
+
+  return munit_suite_main(&suite, NULL, 0, NULL);
+}
@@ -0,0 +1,514 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// No bootlib here, we want to time the real allocator.
+
+typedef struct SnekObject snek_object_t;
+
+int snek_length(snek_object_t* obj);
+snek_object_t* snek_add(snek_object_t* a, snek_object_t* b);
+
+typedef struct {
+  size_t size;
+  snek_object_t** elements;
+} snek_array_t;
+
+// A string lives in the same allocation as its object, right behind it.
+// The header keeps the length, so nothing has to strlen, and a hash that is
+// computed the first time someone asks for it.
+//
+// Long concatenations don't copy, they make a rope node that only points at
+// its two halves. A node's bytes are built the first time someone needs
+// them and kept in flat. Nodes don't own their halves, just like a vector
+// doesn't own its components.
+typedef struct {
+  size_t length;
+  uint64_t hash;         // 0 until snek_string_hash
+  snek_object_t* left;   // both set on rope nodes
+  snek_object_t* right;
+  char* flat;            // a rope node's bytes, once flattened
+  char bytes[];          // a leaf's length bytes plus a null terminator
+} snek_string_t;
+
+// Below this the copy is cheaper than a node and a later flatten
+#define ROPE_MIN_LENGTH 64
+
+typedef struct {
+  snek_object_t* x;
+  snek_object_t* y;
+  snek_object_t* z;
+} snek_vector_t;
+
+typedef enum SnekObjectKind {
+  INTEGER,
+  FLOAT,
+  STRING,
+  VECTOR3,
+  ARRAY,
+} snek_object_kind_t;
+
+typedef union SnekObjectData {
+  int v_int;
+  float v_float;
+  snek_string_t* v_string;
+  snek_vector_t v_vector3;
+  snek_array_t v_array;
+} snek_object_data_t;
+
+typedef struct SnekObject {
+  snek_object_kind_t kind;
+  snek_object_data_t data;
+} snek_object_t;
+
+snek_object_t* new_snek_integer(int value);
+snek_object_t* new_snek_float(float value);
+snek_object_t* new_snek_string(char* value);
+snek_object_t* new_snek_string_length(char* value, size_t length);
+snek_object_t* new_snek_rope(snek_object_t* left, snek_object_t* right);
+char* snek_string_bytes(snek_object_t* obj);
+void snek_string_free(snek_object_t* obj);
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z);
+
+snek_object_t* new_snek_array(size_t size);
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value);
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index);
+
+snek_object_t* snek_add(snek_object_t* a, snek_object_t* b) {
+  if (!a || !b) {
+    return NULL;
+  }
+
+  switch (a->kind) {
+
+    case INTEGER:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_integer(a->data.v_int + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(a->data.v_int + b->data.v_float);
+
+        case STRING:
+        case VECTOR3:
+        case ARRAY:
+          return NULL;
+      }
+
+    case FLOAT:
+      switch (b->kind) {
+        case INTEGER:
+          return new_snek_float(a->data.v_float + b->data.v_int);
+        case FLOAT:
+          return new_snek_float(a->data.v_float + b->data.v_float);
+        case STRING:
+        case VECTOR3:
+        case ARRAY:
+        default:
+          return NULL;
+      }
+
+    case STRING:
+      if (b->kind != STRING) {
+        return NULL;
+      }
+
+      size_t a_length = a->data.v_string->length;
+      size_t b_length = b->data.v_string->length;
+      if (a_length + b_length >= ROPE_MIN_LENGTH) {
+        return new_snek_rope(a, b);
+      }
+
+      // Short enough to copy, one allocation and two memcpys
+      snek_object_t* obj = new_snek_string_length(NULL, a_length + b_length);
+      if (obj == NULL) {
+        return NULL;
+      }
+
+      memcpy(obj->data.v_string->bytes, snek_string_bytes(a), a_length);
+      memcpy(obj->data.v_string->bytes + a_length, snek_string_bytes(b),
+             b_length);
+      return obj;
+
+    case VECTOR3:
+      if (b->kind != VECTOR3) {
+        return NULL;
+      }
+
+      return new_snek_vector3(
+          snek_add(a->data.v_vector3.x, b->data.v_vector3.x),
+          snek_add(a->data.v_vector3.y, b->data.v_vector3.y),
+          snek_add(a->data.v_vector3.z, b->data.v_vector3.z));
+    case ARRAY:
+      if (b->kind != ARRAY) {
+        return NULL;
+      }
+      size_t a_len = a->data.v_array.size;
+      size_t b_len = b->data.v_array.size;
+
+      snek_object_t* arr = new_snek_array(a_len + b_len);
+
+      for (size_t i = 0; i < a->data.v_array.size; ++i) {
+        snek_array_set(arr, i, snek_array_get(a, i));
+      }
+
+      for (size_t i = 0; i < b->data.v_array.size; ++i) {
+        snek_array_set(arr, a_len + i, snek_array_get(b, i));
+      }
+
+      return arr;
+
+    default:
+      return NULL;
+  }
+}
+
+// don't touch below this line
+
+int snek_length(snek_object_t* obj) {
+  if (obj == NULL) {
+    return -1;
+  }
+
+  switch (obj->kind) {
+    case INTEGER:
+      return 1;
+    case FLOAT:
+      return 1;
+    case STRING:
+      return obj->data.v_string->length;
+    case VECTOR3:
+      return 3;
+    case ARRAY:
+      return obj->data.v_array.size;
+    default:
+      return -1;
+  }
+}
+
+snek_object_t* new_snek_array(size_t size) {
+  snek_object_t* obj = malloc(sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_object_t** elements = calloc(size, sizeof(snek_object_t*));
+  if (elements == NULL) {
+    free(obj);
+    return NULL;
+  }
+
+  obj->kind = ARRAY;
+  obj->data.v_array = (snek_array_t){.size = size, .elements = elements};
+  return obj;
+}
+
+bool snek_array_set(snek_object_t* array, size_t index, snek_object_t* value) {
+  if (array == NULL || value == NULL) {
+    return false;
+  }
+
+  if (array->kind != ARRAY) {
+    return false;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return false;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  array->data.v_array.elements[index] = value;
+  return true;
+}
+
+snek_object_t* snek_array_get(snek_object_t* array, size_t index) {
+  if (array == NULL) {
+    return NULL;
+  }
+
+  if (array->kind != ARRAY) {
+    return NULL;
+  }
+
+  if (index >= array->data.v_array.size) {
+    return NULL;
+  }
+
+  // Set the value directly now (already checked size constraint)
+  return array->data.v_array.elements[index];
+}
+
+snek_object_t* new_snek_vector3(snek_object_t* x, snek_object_t* y,
+                                snek_object_t* z) {
+  if (x == NULL || y == NULL || z == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = malloc(sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = VECTOR3;
+  obj->data.v_vector3 = (snek_vector_t){.x = x, .y = y, .z = z};
+
+  return obj;
+}
+
+snek_object_t* new_snek_integer(int value) {
+  snek_object_t* obj = malloc(sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = INTEGER;
+  obj->data.v_int = value;
+  return obj;
+}
+
+snek_object_t* new_snek_float(float value) {
+  snek_object_t* obj = malloc(sizeof(snek_object_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  obj->kind = FLOAT;
+  obj->data.v_float = value;
+  return obj;
+}
+
+// Copies length bytes of value, or leaves them zeroed for the caller to
+// fill in when value is NULL. Freeing the object frees the bytes too.
+snek_object_t* new_snek_string_length(char* value, size_t length) {
+  snek_object_t* obj =
+      calloc(1, sizeof(snek_object_t) + sizeof(snek_string_t) + length + 1);
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_string_t* str = (snek_string_t*)(obj + 1);
+  str->length = length;
+  str->hash = 0;
+  if (value != NULL) {
+    memcpy(str->bytes, value, length);
+  }
+
+  obj->kind = STRING;
+  obj->data.v_string = str;
+  return obj;
+}
+
+snek_object_t* new_snek_string(char* value) {
+  return new_snek_string_length(value, strlen(value));
+}
+
+snek_object_t* new_snek_rope(snek_object_t* left, snek_object_t* right) {
+  if (left == NULL || right == NULL) {
+    return NULL;
+  }
+
+  snek_object_t* obj = calloc(1, sizeof(snek_object_t) + sizeof(snek_string_t));
+  if (obj == NULL) {
+    return NULL;
+  }
+
+  snek_string_t* str = (snek_string_t*)(obj + 1);
+  str->length = left->data.v_string->length + right->data.v_string->length;
+  str->left = left;
+  str->right = right;
+
+  obj->kind = STRING;
+  obj->data.v_string = str;
+  return obj;
+}
+
+// The bytes of a leaf, or of a node already flattened, are ready to copy
+static char* snek_string_ready(snek_string_t* str) {
+  if (str->left == NULL) {
+    return str->bytes;
+  }
+  return str->flat;
+}
+
+// Null terminated bytes of any string, flattening a rope the first time.
+// Appends build left-leaning ropes, so the buffer is filled back to front:
+// the right half is always a short leaf and the explicit stack stays tiny
+// however many pieces went in. Nodes flattened before are copied whole.
+char* snek_string_bytes(snek_object_t* obj) {
+  snek_string_t* root = obj->data.v_string;
+  char* ready = snek_string_ready(root);
+  if (ready != NULL) {
+    return ready;
+  }
+
+  char* flat = malloc(root->length + 1);
+  if (flat == NULL) {
+    return NULL;
+  }
+  flat[root->length] = '\0';
+
+  size_t capacity = 16;
+  size_t count = 0;
+  snek_string_t** stack = malloc(capacity * sizeof(snek_string_t*));
+  if (stack == NULL) {
+    free(flat);
+    return NULL;
+  }
+
+  size_t end = root->length;
+  stack[count++] = root;
+  while (count > 0) {
+    snek_string_t* str = stack[--count];
+    char* bytes = str == root ? NULL : snek_string_ready(str);
+    if (bytes != NULL) {
+      end -= str->length;
+      memcpy(flat + end, bytes, str->length);
+      continue;
+    }
+
+    if (count + 2 > capacity) {
+      capacity *= 2;
+      snek_string_t** grown = realloc(stack, capacity * sizeof(snek_string_t*));
+      if (grown == NULL) {
+        // Unable to realloc, just exit :) get gud
+        exit(1);
+      }
+      stack = grown;
+    }
+    stack[count++] = str->left->data.v_string;
+    stack[count++] = str->right->data.v_string;
+  }
+
+  free(stack);
+  root->flat = flat;
+  return flat;
+}
+
+// Rope nodes own their flattened copy, never their halves
+void snek_string_free(snek_object_t* obj) {
+  free(obj->data.v_string->flat);
+  free(obj);
+}
+
+// FNV-1a, cached in the header. Never 0, so 0 can mean "not yet".
+uint64_t snek_string_hash(snek_object_t* obj) {
+  snek_string_t* str = obj->data.v_string;
+  if (str->hash == 0) {
+    char* bytes = snek_string_bytes(obj);
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < str->length; ++i) {
+      hash ^= (unsigned char)bytes[i];
+      hash *= 1099511628211ull;
+    }
+    str->hash = hash ? hash : 1;
+  }
+  return str->hash;
+}
+
+bool snek_string_equal(snek_object_t* a, snek_object_t* b) {
+  snek_string_t* a_str = a->data.v_string;
+  snek_string_t* b_str = b->data.v_string;
+  if (a_str->length != b_str->length) {
+    return false;
+  }
+  if (a_str->hash != 0 && b_str->hash != 0 && a_str->hash != b_str->hash) {
+    return false;
+  }
+  return memcmp(snek_string_bytes(a), snek_string_bytes(b), a_str->length) ==
+         0;
+}
+//-----------------------------------------------------------------------------
+//---------------------------------Benchmark-----------------------------------
+// Build one long string by appending short pieces, the way a loop doing
+// acc = acc + piece would.
+#define PIECES 100000
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// What snek_add did before ropes, copy both sides every time
+static snek_object_t* snek_add_flat(snek_object_t* a, snek_object_t* b) {
+  size_t a_length = a->data.v_string->length;
+  size_t b_length = b->data.v_string->length;
+  snek_object_t* obj = new_snek_string_length(NULL, a_length + b_length);
+  memcpy(obj->data.v_string->bytes, snek_string_bytes(a), a_length);
+  memcpy(obj->data.v_string->bytes + a_length, snek_string_bytes(b), b_length);
+  return obj;
+}
+
+static double append_flat(snek_object_t** pieces, uint64_t* hash) {
+  double start = now_seconds();
+  snek_object_t* acc = new_snek_string("");
+  for (int i = 0; i < PIECES; ++i) {
+    snek_object_t* next = snek_add_flat(acc, pieces[i]);
+    snek_string_free(acc);
+    acc = next;
+  }
+  *hash = snek_string_hash(acc);
+  double elapsed = now_seconds() - start;
+
+  snek_string_free(acc);
+  return elapsed;
+}
+
+static double append_rope(snek_object_t** pieces, uint64_t* hash) {
+  // Nodes don't own their halves, keep every step around to free later
+  snek_object_t** steps = malloc((PIECES + 1) * sizeof(snek_object_t*));
+
+  double start = now_seconds();
+  steps[0] = new_snek_string("");
+  for (int i = 0; i < PIECES; ++i) {
+    steps[i + 1] = snek_add(steps[i], pieces[i]);
+  }
+  // Hashing needs the bytes, so this includes the one flatten
+  *hash = snek_string_hash(steps[PIECES]);
+  double elapsed = now_seconds() - start;
+
+  for (int i = 0; i <= PIECES; ++i) {
+    snek_string_free(steps[i]);
+  }
+  free(steps);
+  return elapsed;
+}
+
+int main() {
+  snek_object_t** pieces = malloc(PIECES * sizeof(snek_object_t*));
+  for (int i = 0; i < PIECES; ++i) {
+    char piece[16];
+    snprintf(piece, sizeof(piece), "k%06d,", i);
+    pieces[i] = new_snek_string(piece);
+  }
+
+  uint64_t flat_hash = 0;
+  uint64_t rope_hash = 0;
+  double flat_time = append_flat(pieces, &flat_hash);
+  double rope_time = append_rope(pieces, &rope_hash);
+
+  if (flat_hash != rope_hash) {
+    printf("hash mismatch: %llu != %llu\n", (unsigned long long)flat_hash,
+           (unsigned long long)rope_hash);
+    return 1;
+  }
+
+  printf("appending %d pieces of %d bytes\n", PIECES,
+         snek_length(pieces[0]));
+  printf("  copying: %.3f s (%.1f ns/append)\n", flat_time,
+         flat_time * 1e9 / PIECES);
+  printf("  rope:    %.3f s (%.1f ns/append)\n", rope_time,
+         rope_time * 1e9 / PIECES);
+  printf("  speedup: %.1fx\n", flat_time / rope_time);
+
+  for (int i = 0; i < PIECES; ++i) {
+    snek_string_free(pieces[i]);
+  }
+  free(pieces);
+  return 0;
+}